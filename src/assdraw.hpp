@@ -188,6 +188,16 @@ public:
 		long origincross;
 	} sizes;
 
+	struct
+	{
+		long fillthreads;
+		long curvequality;
+		long framecap;
+		bool draftdrag;
+		long draftcurvequality;
+		long draftidle;
+	} performance;
+
 	struct
 	{
 		bool capitalizecmds;
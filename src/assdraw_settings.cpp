@@ -56,6 +56,13 @@ void ASSDrawFrame::InitializeDefaultSettings()
 
 	sizes.origincross = 2;
 
+	performance.fillthreads = 0;
+	performance.curvequality = 2;
+	performance.framecap = 60;
+	performance.draftdrag = true;
+	performance.draftcurvequality = 1;
+	performance.draftidle = 200;
+
 	behaviors.capitalizecmds = false;
 	behaviors.autoaskimgopac = false;
 	behaviors.parse_spc = false;
@@ -88,6 +95,12 @@ void ASSDrawFrame::ApplySettings()
 	m_canvas->color_bg.g = colors.canvas_bg.Green();
 	m_canvas->color_bg.b = colors.canvas_bg.Blue();
 	m_canvas->color_bg.a = colors.canvas_bg.Alpha();
+	m_canvas->fill_threads = performance.fillthreads;
+	m_canvas->curve_quality = performance.curvequality;
+	m_canvas->frame_cap = performance.framecap;
+	m_canvas->draft_drag = performance.draftdrag;
+	m_canvas->draft_curve_quality = performance.draftcurvequality;
+	m_canvas->draft_idle = performance.draftidle;
 	m_canvas->PrepareBackgroundBitmap(-1.0);
 	m_canvas->Refresh();
 
@@ -96,7 +109,11 @@ void ASSDrawFrame::ApplySettings()
 	PrevVec shapes = shapelib->GetShapePreviews();
 	int n = shapes.size();
 	for (int i = 0; i < n; i++)
+	{
 		wxColourToAggRGBA(colors.library_shape, shapes[i]->rgba_shape);
+		shapes[i]->curve_quality = performance.curvequality;
+		shapes[i]->frame_cap = performance.framecap;
+	}
 	shapelib->libarea->Refresh();
 
 	m_canvas->SetDrawCmdSet(behaviors.parse_spc? _T("m n l b s p c _"):_T("m n l b _"));
@@ -154,6 +171,13 @@ void ASSDrawFrame::LoadSettings()
 
 	CFGREAD(sizes.origincross)
 
+	CFGREAD(performance.fillthreads)
+	CFGREAD(performance.curvequality)
+	CFGREAD(performance.framecap)
+	CFGREAD(performance.draftdrag)
+	CFGREAD(performance.draftcurvequality)
+	CFGREAD(performance.draftidle)
+
 	CFGREAD(behaviors.autoaskimgopac)
 	CFGREAD(behaviors.capitalizecmds)
 	CFGREAD(behaviors.parse_spc)
@@ -194,6 +218,13 @@ void ASSDrawFrame::SaveSettings()
 
 	CFGWRITE(sizes.origincross)
 
+	CFGWRITE(performance.fillthreads)
+	CFGWRITE(performance.curvequality)
+	CFGWRITE(performance.framecap)
+	CFGWRITE(performance.draftdrag)
+	CFGWRITE(performance.draftcurvequality)
+	CFGWRITE(performance.draftidle)
+
 	CFGWRITE(behaviors.autoaskimgopac)
 	CFGWRITE(behaviors.capitalizecmds)
 	CFGWRITE(behaviors.parse_spc)
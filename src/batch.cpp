@@ -0,0 +1,452 @@
+/*
+* Copyright (c) 2007, ai-chan
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the ASSDraw3 Team nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY AI-CHAN ``AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL AI-CHAN BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+///////////////////////////////////////////////////////////////////////////////
+// Name:        batch.cpp
+// Purpose:     assdraw_batch, applies an operation to every drawing in an .ass file
+// Author:      ai-chan
+// Created:     10/17/26
+// Copyright:   (c) ai-chan
+// Licence:     3-clause BSD
+///////////////////////////////////////////////////////////////////////////////
+
+// usage: assdraw_batch [-t m11,m12,m21,m22,mx,my,nx,ny] [-s factor] [-m x,y] [-j threads] in.ass out.ass
+//
+// every drawing ({\p1} etc.) in the Dialogue lines of in.ass is parsed, transformed,
+// moved and generated again; with no operation given the drawings are just normalized.
+// the amounts are in pixels, so they're scaled for \p2 and up like the drawings are.
+// only wxBase is used: no wxApp, no windows
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <wx/init.h>
+#include <wx/cmdline.h>
+#include <wx/thread.h>
+#include <wx/tokenzr.h>
+
+#ifdef __UNIX__
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#else
+	#include <wx/file.h>
+#endif
+
+#include "shape.hpp"
+
+// the input file, mapped into memory where we can, read into memory otherwise
+class InputFile
+{
+public:
+	InputFile() : data(NULL), size(0) { }
+	~InputFile();
+
+	bool Open(const wxString& path);
+
+	const char *data;
+	size_t size;
+
+private:
+#ifndef __UNIX__
+	std::vector<char> buffer;
+#endif
+};
+
+#ifdef __UNIX__
+bool InputFile::Open(const wxString& path)
+{
+	int fd = open(path.fn_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	bool ok = fstat(fd, &st) == 0;
+	if (ok && st.st_size > 0)
+	{
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		ok = map != MAP_FAILED;
+		if (ok)
+		{
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			data = (const char*) map;
+			size = st.st_size;
+		}
+	}
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+	return ok;
+}
+
+InputFile::~InputFile()
+{
+	if (data != NULL)
+		munmap((void*) data, size);
+}
+#else
+bool InputFile::Open(const wxString& path)
+{
+	wxFile file(path);
+	if (!file.IsOpened())
+		return false;
+	buffer.resize(file.Length());
+	if (!buffer.empty() && file.Read(&buffer[0], buffer.size()) != (ssize_t) buffer.size())
+		return false;
+	data = buffer.empty()? NULL:&buffer[0];
+	size = buffer.size();
+	return true;
+}
+
+InputFile::~InputFile()
+{
+}
+#endif
+
+// number of lines a worker takes at a time
+static const size_t BATCH_BLOCKSIZE = 64;
+
+// what to do with each drawing
+struct BatchOptions
+{
+	BatchOptions() : transform(false), movex(0), movey(0) { }
+
+	bool transform;
+	double m11, m12, m21, m22, mx, my, nx, ny;
+	double movex, movey;
+};
+
+// the lines of the input file and what the workers made of them
+struct BatchJob
+{
+	BatchJob(const BatchOptions& opt) : options(opt), next(0), drawings(0) { }
+
+	struct Line
+	{
+		Line(const char *b, size_t l) : begin(b), len(l), changed(false) { }
+
+		// the line in the input, including its line break
+		const char *begin;
+		size_t len;
+
+		// set by the worker if the line has drawings in it
+		bool changed;
+		std::string out;
+	};
+
+	const BatchOptions options;
+	std::vector<Line> lines;
+
+	// the workers take lines in blocks of BATCH_BLOCKSIZE, starting from next
+	wxMutex mutex;
+	size_t next;
+
+	// number of drawings processed
+	size_t drawings;
+};
+
+class BatchWorker : public wxThread
+{
+public:
+	BatchWorker(BatchJob& j) : wxThread(wxTHREAD_JOINABLE), job(j) { }
+
+protected:
+	virtual ExitCode Entry();
+
+	// rewrite the drawings in line.begin into line.out; false if there aren't any
+	bool ProcessLine(BatchJob::Line& line, size_t& drawings);
+	// parse, modify and generate one drawing in drawing mode plevel, appended to out
+	bool ProcessDrawing(const char *text, size_t len, int plevel, std::string& out);
+
+	BatchJob& job;
+	// every worker parses with its own shape
+	ASSDrawShape shape;
+};
+
+wxThread::ExitCode BatchWorker::Entry()
+{
+	size_t drawings = 0;
+	for (;;)
+	{
+		size_t first;
+		{
+			wxMutexLocker lock(job.mutex);
+			first = job.next;
+			job.next += BATCH_BLOCKSIZE;
+		}
+		if (first >= job.lines.size())
+			break;
+
+		size_t last = wxMin(first + BATCH_BLOCKSIZE, job.lines.size());
+		for (size_t i = first; i < last; i++)
+			job.lines[i].changed = ProcessLine(job.lines[i], drawings);
+	}
+
+	wxMutexLocker lock(job.mutex);
+	job.drawings += drawings;
+	return 0;
+}
+
+bool BatchWorker::ProcessLine(BatchJob::Line& line, size_t& drawings)
+{
+	static const char dialogue[] = "Dialogue:";
+	const size_t dialoguelen = sizeof(dialogue) - 1;
+
+	const char *p = line.begin;
+	const char *end = line.begin + line.len;
+	if (line.len < dialoguelen || memcmp(p, dialogue, dialoguelen) != 0)
+		return false;
+
+	// the line break isn't part of the text
+	while (end != p && (end[-1] == '\n' || end[-1] == '\r'))
+		end--;
+
+	// Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text
+	int commas = 0;
+	while (p != end && commas < 9)
+		if (*p++ == ',')
+			commas++;
+	if (commas < 9)
+		return false;
+
+	bool changed = false;
+	int plevel = 0;
+	std::string out(line.begin, p - line.begin);
+	while (p != end)
+	{
+		if (*p == '{')
+		{
+			// override block; look for \p tags in it, which turn drawing mode on/off
+			const char *close = (const char*) memchr(p, '}', end - p);
+			const char *blockend = close != NULL? close + 1:end;
+			for (const char *t = p; t + 2 < blockend; t++)
+			{
+				if (t[0] == '\\' && t[1] == 'p' && t[2] >= '0' && t[2] <= '9')
+				{
+					plevel = 0;
+					for (t += 2; t != blockend && *t >= '0' && *t <= '9'; t++)
+						plevel = plevel * 10 + (*t - '0');
+					t--;
+				}
+			}
+			out.append(p, blockend - p);
+			p = blockend;
+		}
+		else
+		{
+			// text up to the next override block
+			const char *open = (const char*) memchr(p, '{', end - p);
+			const char *textend = open != NULL? open:end;
+			if (plevel > 0 && ProcessDrawing(p, textend - p, plevel, out))
+			{
+				changed = true;
+				drawings++;
+			}
+			else
+				out.append(p, textend - p);
+			p = textend;
+		}
+	}
+
+	if (changed)
+	{
+		out.append(end, line.begin + line.len - end);
+		line.out.swap(out);
+	}
+	return changed;
+}
+
+bool BatchWorker::ProcessDrawing(const char *text, size_t len, int plevel, std::string& out)
+{
+	shape.BeginParseASS();
+	shape.FeedParseASS(text, len);
+	if (shape.FinishParseASS() == 0)
+		return false;
+
+	// in \pN drawings a pixel is 2^(N-1) units
+	double units = plevel < 32? (double) (1u << (plevel - 1)):1.0;
+	const BatchOptions& opt = job.options;
+	if (opt.transform)
+		shape.Transform(opt.m11, opt.m12, opt.m21, opt.m22, opt.mx * units, opt.my * units, opt.nx * units, opt.ny * units);
+	if (opt.movex != 0 || opt.movey != 0)
+		shape.MovePoints((int) floor(opt.movex * units + 0.5), (int) floor(opt.movey * units + 0.5));
+
+	wxString ass = shape.GenerateASS();
+	// GenerateASS ends every command with a space, the last one isn't needed here
+	ass.Trim();
+	out.append(ass.mb_str(wxConvUTF8));
+	return true;
+}
+
+// parse a comma separated list of exactly n numbers
+static bool ParseNumbers(const wxString& str, double *values, size_t n)
+{
+	wxStringTokenizer tkz(str, _T(","));
+	size_t i = 0;
+	while (tkz.HasMoreTokens())
+	{
+		if (i == n || !tkz.GetNextToken().Trim().Trim(false).ToDouble(&values[i]))
+			return false;
+		i++;
+	}
+	return i == n;
+}
+
+static const wxCmdLineEntryDesc cmdlinedesc[] =
+{
+	{ wxCMD_LINE_SWITCH, "h", "help", "show this help", wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
+	{ wxCMD_LINE_OPTION, "t", "transform", "transform with m11,m12,m21,m22,mx,my,nx,ny (as in the Transform dialog)", wxCMD_LINE_VAL_STRING, 0 },
+	{ wxCMD_LINE_OPTION, "s", "scale", "scale by a factor, around 0,0", wxCMD_LINE_VAL_DOUBLE, 0 },
+	{ wxCMD_LINE_OPTION, "m", "move", "move by x,y pixels", wxCMD_LINE_VAL_STRING, 0 },
+	{ wxCMD_LINE_OPTION, "j", "jobs", "number of worker threads (default: number of CPUs)", wxCMD_LINE_VAL_NUMBER, 0 },
+	{ wxCMD_LINE_PARAM, NULL, NULL, "input.ass", wxCMD_LINE_VAL_STRING, 0 },
+	{ wxCMD_LINE_PARAM, NULL, NULL, "output.ass", wxCMD_LINE_VAL_STRING, 0 },
+	{ wxCMD_LINE_NONE }
+};
+
+int main(int argc, char **argv)
+{
+	// wxBase only, for the threads and strings
+	wxInitializer initializer(argc, argv);
+	if (!initializer.IsOk())
+	{
+		fprintf(stderr, "assdraw_batch: failed to initialize wxWidgets\n");
+		return 1;
+	}
+
+	wxCmdLineParser cmdline(cmdlinedesc, argc, argv);
+	if (cmdline.Parse() != 0)
+		return 1;
+
+	BatchOptions options;
+	wxString str;
+	double dbl;
+	if (cmdline.Found(_T("t"), &str))
+	{
+		double m[8];
+		if (!ParseNumbers(str, m, 8))
+		{
+			fprintf(stderr, "assdraw_batch: --transform needs 8 numbers\n");
+			return 1;
+		}
+		options.transform = true;
+		options.m11 = m[0], options.m12 = m[1], options.m21 = m[2], options.m22 = m[3];
+		options.mx = m[4], options.my = m[5], options.nx = m[6], options.ny = m[7];
+	}
+	if (cmdline.Found(_T("s"), &dbl))
+	{
+		if (!options.transform)
+		{
+			options.transform = true;
+			options.m11 = options.m22 = 1.0;
+			options.m12 = options.m21 = 0.0;
+			options.mx = options.my = options.nx = options.ny = 0.0;
+		}
+		options.m11 *= dbl, options.m12 *= dbl, options.m21 *= dbl, options.m22 *= dbl;
+	}
+	if (cmdline.Found(_T("m"), &str))
+	{
+		double m[2];
+		if (!ParseNumbers(str, m, 2))
+		{
+			fprintf(stderr, "assdraw_batch: --move needs 2 numbers\n");
+			return 1;
+		}
+		options.movex = m[0], options.movey = m[1];
+	}
+	long threads = wxThread::GetCPUCount();
+	cmdline.Found(_T("j"), &threads);
+	if (threads < 1)
+		threads = 1;
+
+	InputFile input;
+	if (!input.Open(cmdline.GetParam(0)))
+	{
+		fprintf(stderr, "assdraw_batch: can't read %s\n", (const char*) cmdline.GetParam(0).mb_str());
+		return 1;
+	}
+
+	// split into lines, keeping the line breaks with them
+	BatchJob job(options);
+	for (const char *p = input.data, *end = input.data + input.size; p != end; )
+	{
+		const char *nl = (const char*) memchr(p, '\n', end - p);
+		const char *next = nl != NULL? nl + 1:end;
+		job.lines.push_back(BatchJob::Line(p, next - p));
+		p = next;
+	}
+
+	std::vector<BatchWorker*> workers;
+	for (long i = 0; i < threads; i++)
+	{
+		BatchWorker *worker = new BatchWorker(job);
+		if (worker->Run() != wxTHREAD_NO_ERROR)
+		{
+			delete worker;
+			break;
+		}
+		workers.push_back(worker);
+	}
+	if (workers.empty())
+	{
+		fprintf(stderr, "assdraw_batch: failed to start worker threads\n");
+		return 1;
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i]->Wait();
+		delete workers[i];
+	}
+
+	FILE *output = fopen(cmdline.GetParam(1).fn_str(), "wb");
+	if (output == NULL)
+	{
+		fprintf(stderr, "assdraw_batch: can't write %s\n", (const char*) cmdline.GetParam(1).mb_str());
+		return 1;
+	}
+	bool ok = true;
+	for (size_t i = 0; i < job.lines.size() && ok; i++)
+	{
+		const BatchJob::Line& line = job.lines[i];
+		if (line.changed)
+			ok = fwrite(line.out.data(), 1, line.out.size(), output) == line.out.size();
+		else
+			ok = fwrite(line.begin, 1, line.len, output) == line.len;
+	}
+	ok = fclose(output) == 0 && ok;
+	if (!ok)
+	{
+		fprintf(stderr, "assdraw_batch: error writing %s\n", (const char*) cmdline.GetParam(1).mb_str());
+		return 1;
+	}
+
+	fprintf(stderr, "assdraw_batch: %lu drawings in %lu lines, %lu threads\n",
+		(unsigned long) job.drawings, (unsigned long) job.lines.size(), (unsigned long) workers.size());
+	return 0;
+}
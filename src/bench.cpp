@@ -0,0 +1,799 @@
+/*
+* Copyright (c) 2007, ai-chan
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the ASSDraw3 Team nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY AI-CHAN ``AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL AI-CHAN BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+///////////////////////////////////////////////////////////////////////////////
+// Name:        bench.cpp
+// Purpose:     throughput benchmarks for the drawing engine
+// Author:      ai-chan
+// Created:     10/17/26
+// Copyright:   (c) ai-chan
+// Licence:     3-clause BSD
+///////////////////////////////////////////////////////////////////////////////
+
+#include "renderer.hpp"
+#include "agg_bcspline.h"
+
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+#include <wx/tokenzr.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// usage: assdraw_bench [--format=csv|json] [--sizes=n,n,...] [--runs=n] [--threads=n]
+//
+// times the engine on synthetic drawings of 1k to 1M commands and prints one record per
+// operation and drawing size; rendering goes to an offscreen buffer, no display is needed;
+// --threads sets the renderer's fill_threads (default 1, 0 is one per CPU); a tall fill is
+// also timed with one thread and with that many (one per CPU if it's 1). The pixel
+// operations the layers are drawn with (clear, span fill, constant colour blend, copy) are
+// timed first on a 4K frame, with AGG's own pixel format and with each of the
+// GUI::PixelKernels levels the CPU can run. The Render_zoom rows also give how far the
+// flattened S splines get from the curves, and the run fails if that's over 1/curve_quality
+
+// the renderer, opened up for timing, plus a copy of the wxStringTokenizer based
+// parser it used to have, so the single pass parser can be measured (and checked) against it
+class BenchEngine : public ASSDrawRenderer
+{
+public:
+	int LegacyParseASS(wxString str);
+
+	// time only the path construction part of Render
+	void ConstructPaths()
+	{
+		agg::trans_affine mtx;
+		ConstructPathsAndCurves(mtx, rm_path, rb_path, rm_curve);
+		delete rm_path;
+		delete rb_path;
+		delete rm_curve;
+	}
+
+	// number of vertices the outline of the fill is flattened into at the current zoom
+	size_t CountVertices()
+	{
+		agg::trans_affine mtx;
+		ConstructPathsAndCurves(mtx, rm_path, rb_path, rm_curve);
+		size_t n = 0;
+		double x, y;
+		rm_curve->rewind(0);
+		while (!agg::is_stop(rm_curve->vertex(&x, &y)))
+			n++;
+		delete rm_path;
+		delete rb_path;
+		delete rm_curve;
+		return n;
+	}
+
+	// the farthest, in pixels at the current zoom, the flattened S splines are from the
+	// curves they stand for, evaluated exactly at 15 places along each of their chords;
+	// the splines are those the last Render or ConstructPaths flattened
+	double SplineError()
+	{
+		double worst = 0;
+		for (DrawCmdList::iterator it = cmds.begin(); it != cmds.end(); it++)
+		{
+			if ((*it)->type != S)
+				continue;
+			DrawCmd_S *s = static_cast<DrawCmd_S*>(*it);
+			unsigned np = s->controlpoints.size();
+			// with 2 points AGG draws the line between them
+			if (np < 3 || s->IsGeometryDirty())
+				continue;
+			agg::bcspline sx, sy;
+			sx.init(np);
+			sy.init(np);
+			unsigned i = 0;
+			for (PointList::iterator p = s->controlpoints.begin(); p != s->controlpoints.end(); p++, i++)
+			{
+				sx.add_point(i, (*p)->x());
+				sy.add_point(i, (*p)->y());
+			}
+			sx.prepare();
+			sy.prepare();
+			// vertex k is at abscissa k * splinestep, the last at np - 1
+			const std::vector<double>& xy = s->splinexy;
+			for (size_t k = 0; k + 1 < s->splinecmds.size() && agg::is_vertex(s->splinecmds[k + 1]); k++)
+			{
+				double a = k * s->splinestep, b = std::min(a + s->splinestep, np - 1.0);
+				double dx = xy[k * 2 + 2] - xy[k * 2], dy = xy[k * 2 + 3] - xy[k * 2 + 1];
+				double len2 = dx * dx + dy * dy;
+				for (int j = 1; j < 16; j++)
+				{
+					double t = a + (b - a) * j / 16;
+					double px = sx.get(t) - xy[k * 2], py = sy.get(t) - xy[k * 2 + 1];
+					double u = len2 > 0? std::max(0.0, std::min(1.0, (px * dx + py * dy) / len2)):0.0;
+					worst = std::max(worst, sqrt((px - u * dx) * (px - u * dx) + (py - u * dy) * (py - u * dy)));
+				}
+			}
+		}
+		return worst * pointsys->scale;
+	}
+};
+
+int BenchEngine::LegacyParseASS(wxString str)
+{
+	ResetEngine(false);
+	str.Replace(_T("\t"), _T(""));
+	str.Replace(_T("\r"), _T(""));
+	str.Replace(_T("\n"), _T(""));
+	str = str.Lower() + _T(" _ _");
+	wxStringTokenizer tkz(str, _T(" "));
+	wxString currcmd(_T(""));
+	std::vector<int> val;
+	wxString token;
+	long tmp_int;
+
+	bool n_collected = false;
+	DrawCmd_S *s_command = NULL;
+	wxPoint tmp_n_pnt;
+
+	while (tkz.HasMoreTokens())
+	{
+		token = tkz.GetNextToken();
+
+		if (drawcmdset.Find(token) > -1)
+		{
+			bool done;
+
+			do {
+				done = true;
+
+				// N
+				if (currcmd.IsSameAs(_T("n")) && val.size() >= 2)
+				{
+					tmp_n_pnt.x = val[0], tmp_n_pnt.y = val[1];
+					n_collected = true;
+				}
+				else if(n_collected)
+				{
+					AppendCmd(NewCmd(L, tmp_n_pnt.x, tmp_n_pnt.y));
+					n_collected = false;
+				}
+
+				if (s_command != NULL)
+				{
+					bool ends = true;
+					if (currcmd.IsSameAs(_T("p"))&& val.size() >= 2)
+					{
+						s_command->m_point->type = CP;
+						s_command->m_point->num = s_command->controlpoints.size() + 1;
+						s_command->controlpoints.push_back(s_command->m_point);
+						s_command->m_point = new (pointsys) Point(val[0], val[1], pointsys, MP, s_command);
+						ends = false;
+					}
+					else if (currcmd.IsSameAs(_T("c")))
+						s_command->closed = true;
+
+					if (ends)
+					{
+						AppendCmd(s_command);
+						s_command = NULL;
+					}
+				}
+
+				// M
+				if (currcmd.IsSameAs(_T("m")) && val.size() >= 2)
+					AppendCmd(NewCmd(M, val[0], val[1]));
+
+				// L
+				if (currcmd.IsSameAs(_T("l")) && val.size() >= 2)
+				{
+					AppendCmd(NewCmd(L, val[0], val[1]));
+					val.erase(val.begin(), val.begin()+2);
+					if (val.size() >= 2)
+						done = false;
+				}
+
+				// B
+				if (currcmd.IsSameAs(_T("b")) && val.size() >= 6)
+				{
+					AppendCmd(new (pointsys) DrawCmd_B(val[4], val[5], val[0], val[1], val[2], val[3], pointsys, LastCmd()));
+					val.erase(val.begin(), val.begin()+6);
+					if (val.size() >= 6)
+						done = false;
+				}
+
+				// S
+				if (currcmd.IsSameAs(_T("s")) && val.size() >= 6)
+				{
+					int num = (val.size() / 2) * 2;
+					std::vector<int> val2;
+					int i = 0;
+					for (; i < num - 2; i++)
+						val2.push_back(val[i]);
+
+					s_command = new (pointsys) DrawCmd_S(val[num - 2], val[num - 1], val2, pointsys, LastCmd());
+				}
+			} while (!done);
+
+			val.clear();
+			currcmd = token;
+		}
+		else if (token.ToLong(&tmp_int))
+			val.push_back((int) tmp_int);
+	}
+
+	return (int) cmds.size();
+}
+
+// a karaoke-style drawing of at least ncmds commands: mostly greedy l/b runs, some splines,
+// mixed case and line breaks, all within -1000..1000
+static wxString MakeDrawing(size_t ncmds)
+{
+	wxString s;
+	s.Alloc(ncmds * 20);
+	unsigned int seed = 12345;
+	size_t cmds = 0;
+	for (int n = 0; cmds < ncmds; n++)
+	{
+		seed = seed * 1103515245 + 12345;
+		int x = (int) ((seed >> 16) % 2000) - 1000;
+		int y = (int) ((seed >> 4) % 2000) - 1000;
+		switch (n % 8)
+		{
+			case 0:
+				s << _T("m ") << x << _T(" ") << y << _T(" ");
+				cmds += 1;
+				break;
+			case 1:
+				s << _T("l ") << x << _T(" ") << y << _T(" ") << y << _T(" ") << x << _T(" ") << -x << _T(" ") << -y << _T(" ");
+				cmds += 3;
+				break;
+			case 2:
+				s << _T("B ") << x << _T(" ") << y << _T(" ") << y << _T(" ") << x << _T(" ") << -x << _T(" ") << -y << _T("\r\n");
+				cmds += 1;
+				break;
+			case 3:
+				s << _T("s ") << x << _T(" ") << y << _T(" ") << y << _T(" ") << x << _T(" ") << -x << _T(" ") << -y
+				  << _T(" p ") << x / 2 << _T(" ") << y / 2 << _T(" c ");
+				cmds += 1;
+				break;
+			case 4:
+				s << _T("n ") << x << _T(" ") << y << _T("\t");
+				cmds += 1;
+				break;
+			default:
+				s << _T("b ") << x << _T(" ") << y << _T(" ") << y << _T(" ") << x << _T(" ") << -x << _T(" ") << -y << _T(" ");
+				cmds += 1;
+				break;
+		}
+	}
+	return s;
+}
+
+// collects the timings of one operation
+struct BenchResult
+{
+	BenchResult(const char *n, size_t c, size_t o = 1) : name(n), cmds(c), ops(o), runs(0), best(0), total(0), bytes(0), vertices(0), vertices_saved(0), spline_error(0) { }
+
+	void Add(double ms, const DrawPool::Stats& stats)
+	{
+		if (runs == 0 || ms < best)
+			best = ms;
+		total += ms;
+		runs++;
+		pool = stats;
+	}
+
+	const char *name;
+	size_t cmds;
+	// operations per run (e.g. number of lookups)
+	size_t ops;
+	int runs;
+	double best, total;
+	// bytes processed per run, for MB/s
+	size_t bytes;
+	// for rendering: vertices in the flattened outline, and how many fewer than with
+	// the fixed flattening (curve_quality 0) that's all there was before
+	size_t vertices;
+	long vertices_saved;
+	// for rendering: the farthest the flattened S splines are from the curves, in pixels
+	double spline_error;
+	// what the engine's point/command pool did during the last run
+	DrawPool::Stats pool;
+};
+
+class Bench
+{
+public:
+	Bench(bool _json, int _runs, int threads) : json(_json), runs(_runs), records(0), failed(false) { engine.fill_threads = threads; }
+
+	void Begin();
+	void RunPixels();
+	void RunTallFill();
+	void Run(size_t ncmds);
+	bool End();
+
+protected:
+	void Print(const BenchResult& r);
+	template <class PixFmt> void RunPixelFormat(const char *impl);
+
+	// time one run
+	void Start()
+	{
+		engine.ResetAllocStats();
+		sw.Start();
+	}
+	void Stop(BenchResult& r) { r.Add(sw.TimeInMicro().ToDouble() / 1000.0, engine.AllocStats()); }
+
+	BenchEngine engine;
+	wxStopWatch sw;
+	bool json;
+	int runs;
+	int records;
+	bool failed;
+};
+
+void Bench::Begin()
+{
+	if (json)
+		printf("{\n  \"benchmarks\": [");
+	else
+		printf("benchmark,commands,ops,runs,best_ms,mean_ms,mb_per_s,pool_allocs,pool_chunks,vertices,vertices_saved,spline_error_px\n");
+}
+
+bool Bench::End()
+{
+	if (json)
+		printf("\n  ]\n}\n");
+	return !failed;
+}
+
+void Bench::Print(const BenchResult& r)
+{
+	double mean = r.runs > 0? r.total / r.runs:0.0;
+	double mbs = r.bytes > 0 && r.best > 0? r.bytes / (1024.0 * 1024.0) / (r.best / 1000.0):0.0;
+	if (json)
+		printf("%s\n    { \"benchmark\": \"%s\", \"commands\": %lu, \"ops\": %lu, \"runs\": %d, \"best_ms\": %.3f, \"mean_ms\": %.3f, \"mb_per_s\": %.2f, \"pool_allocs\": %lu, \"pool_chunks\": %lu, \"vertices\": %lu, \"vertices_saved\": %ld, \"spline_error_px\": %.4f }",
+			records > 0? ",":"", r.name, (unsigned long) r.cmds, (unsigned long) r.ops, r.runs, r.best, mean, mbs, r.pool.allocs, r.pool.chunks, (unsigned long) r.vertices, r.vertices_saved, r.spline_error);
+	else
+		printf("%s,%lu,%lu,%d,%.3f,%.3f,%.2f,%lu,%lu,%lu,%ld,%.4f\n", r.name, (unsigned long) r.cmds, (unsigned long) r.ops, r.runs, r.best, mean, mbs, r.pool.allocs, r.pool.chunks, (unsigned long) r.vertices, r.vertices_saved, r.spline_error);
+	fflush(stdout);
+	records++;
+}
+
+void Bench::RunPixels()
+{
+	RunPixelFormat<BenchEngine::PixelFormat::GenericAGGType>("agg");
+	for (int level = GUI::PixelKernels::SCALAR; level <= GUI::PixelKernels::Best(); level++)
+	{
+		GUI::PixelKernels::Use((GUI::PixelKernels::Level) level);
+		RunPixelFormat<BenchEngine::PixelFormat::AGGType>(GUI::PixelKernels::Name((GUI::PixelKernels::Level) level));
+	}
+	GUI::PixelKernels::Use(GUI::PixelKernels::Best());
+}
+
+template <class PixFmt>
+void Bench::RunPixelFormat(const char *impl)
+{
+	const int width = 3840, height = 2160;
+	const int stride = width * PixFmt::pix_width;
+	std::vector<agg::int8u> pixels(stride * height), source(stride * height, 0x80);
+	agg::rendering_buffer rbuf(&pixels[0], width, height, stride);
+	agg::rendering_buffer sbuf(&source[0], width, height, stride);
+	PixFmt pixf(rbuf);
+	agg::renderer_base<PixFmt> rbase(pixf);
+	typename PixFmt::color_type opaque(agg::rgba(0.2, 0.4, 0.6));
+	typename PixFmt::color_type translucent(agg::rgba(0.2, 0.4, 0.6, 0.5));
+
+	// Draw_Clear, the solid spans of a fill (64 pixels every 128), the background image
+	// opacity and the layers being copied onto each other
+	const char *ops[] = { "clear", "fill_spans", "blend", "copy" };
+	for (int op = 0; op < 4; op++)
+	{
+		std::string name = std::string("Pixels_") + ops[op] + "_4K_" + impl;
+		BenchResult r(name.c_str(), 0);
+		r.bytes = op == 1? stride * height / 2:stride * height;
+		for (int i = 0; i < runs; i++)
+		{
+			Start();
+			if (op == 0)
+				rbase.copy_bar(0, 0, width - 1, height - 1, opaque);
+			else if (op == 1)
+			{
+				for (int y = 0; y < height; y++)
+					for (int x = 0; x < width; x += 128)
+						rbase.copy_hline(x, y, x + 63, opaque);
+			}
+			else if (op == 2)
+				rbase.blend_bar(0, 0, width - 1, height - 1, translucent, agg::cover_full);
+			else
+				rbase.copy_from(sbuf);
+			Stop(r);
+		}
+		Print(r);
+	}
+}
+
+void Bench::RunTallFill()
+{
+	// a comb of lines from the top of a 4K frame to the bottom, so that every line
+	// crosses every band of the threaded fill
+	const int width = 3840, height = 2160;
+	wxString drawing(_T("m 0 0 l"));
+	for (int x = 3; x < width; x += 3)
+		drawing << _T(" ") << x << _T(" ") << (x % 6? height:0);
+	drawing << _T(" ") << width - 1 << _T(" 0");
+	size_t ncmds = engine.ParseASS(drawing);
+	engine._PointSystem()->Set(1.0, 0, 0);
+
+	const int stride = width * BenchEngine::PixelFormat::AGGType::pix_width;
+	std::vector<agg::int8u> single(stride * height), threaded(stride * height);
+	agg::rendering_buffer sbuf(&single[0], width, height, stride);
+	agg::rendering_buffer tbuf(&threaded[0], width, height, stride);
+	int threads = engine.fill_threads;
+	char name[64];
+	sprintf(name, "Render_tall_edges_4K_%d_threads", threads == 1? 0:threads);
+	BenchResult one("Render_tall_edges_4K_1_thread", ncmds);
+	BenchResult many(name, ncmds);
+	for (int i = 0; i < runs; i++)
+	{
+		engine.fill_threads = 1;
+		Start();
+		engine.Render(sbuf);
+		Stop(one);
+		engine.fill_threads = threads == 1? 0:threads;
+		Start();
+		engine.Render(tbuf);
+		Stop(many);
+	}
+	engine.fill_threads = threads;
+	Print(one);
+	Print(many);
+	// the bands' clipper rounds where it cuts the lines at their edges, which moves the
+	// coverage of some pixels by a level or few, but no more
+	int worst = 0;
+	for (size_t i = 0; i < single.size(); i++)
+		worst = std::max(worst, abs(single[i] - threaded[i]));
+	if (worst > 4)
+	{
+		fprintf(stderr, "assdraw_bench: the threaded fill of the tall edges is %d levels off the single-threaded one\n", worst);
+		failed = true;
+	}
+}
+
+void Bench::Run(size_t ncmds)
+{
+	wxString drawing = MakeDrawing(ncmds);
+
+	// ParseASS (and the old parser, which is too slow to wait for on the biggest drawings)
+	BenchResult parse("ParseASS", ncmds);
+	parse.bytes = drawing.Len();
+	for (int i = 0; i < runs; i++)
+	{
+		Start();
+		engine.ParseASS(drawing);
+		Stop(parse);
+	}
+	Print(parse);
+	wxString ass = engine.GenerateASS();
+
+	if (ncmds <= 100000)
+	{
+		BenchResult legacy("ParseASS_legacy", ncmds);
+		legacy.bytes = drawing.Len();
+		for (int i = 0; i < runs; i++)
+		{
+			Start();
+			engine.LegacyParseASS(drawing);
+			Stop(legacy);
+		}
+		Print(legacy);
+		if (!engine.GenerateASS().IsSameAs(ass))
+		{
+			fprintf(stderr, "assdraw_bench: ParseASS and the legacy parser disagree on %lu commands\n", (unsigned long) ncmds);
+			failed = true;
+		}
+		engine.ParseASS(drawing);
+	}
+
+	// GenerateASS, with every command changed, and with nothing changed
+	BenchResult generate("GenerateASS", ncmds);
+	BenchResult generatecached("GenerateASS_unchanged", ncmds);
+	for (int i = 0; i < runs; i++)
+	{
+		engine.MovePoints(i % 2? -1:1, 0);
+		Start();
+		generate.bytes = engine.GenerateASS().Len();
+		Stop(generate);
+		Start();
+		generatecached.bytes = engine.GenerateASS().Len();
+		Stop(generatecached);
+	}
+	Print(generate);
+	Print(generatecached);
+
+	// the binary encoding, which has to give back exactly the same drawing
+	ass = engine.GenerateASS();
+	std::string binary;
+	BenchResult encode("GenerateBinary", ncmds);
+	BenchResult decode("ParseBinary", ncmds);
+	for (int i = 0; i < runs; i++)
+	{
+		Start();
+		engine.GenerateBinary(binary);
+		Stop(encode);
+		Start();
+		engine.ParseBinary(binary);
+		Stop(decode);
+	}
+	encode.bytes = decode.bytes = binary.size();
+	Print(encode);
+	Print(decode);
+	std::string again;
+	engine.GenerateBinary(again);
+	if (!engine.GenerateASS().IsSameAs(ass) || again != binary)
+	{
+		fprintf(stderr, "assdraw_bench: the binary encoding of %lu commands doesn't round-trip\n", (unsigned long) ncmds);
+		failed = true;
+	}
+
+	// from scratch (every S spline flattened again), after one point has moved (the
+	// paths are put together from the cached splines) and with nothing changed
+	BenchResult construct("ConstructPathsAndCurves", ncmds);
+	for (int i = 0; i < runs; i++)
+	{
+		engine._PointSystem()->store.SetAllDirty();
+		Start();
+		engine.ConstructPaths();
+		Stop(construct);
+	}
+	Print(construct);
+
+	Point *moved = (*engine.Iterator())->m_point;
+	BenchResult constructmoved("ConstructPathsAndCurves_point_moved", ncmds);
+	for (int i = 0; i < runs; i++)
+	{
+		moved->setXY(moved->x() + 1, moved->y());
+		Start();
+		engine.ConstructPaths();
+		Stop(constructmoved);
+	}
+	Print(constructmoved);
+
+	BenchResult constructcached("ConstructPathsAndCurves_unchanged", ncmds);
+	for (int i = 0; i < runs; i++)
+	{
+		Start();
+		engine.ConstructPaths();
+		Stop(constructcached);
+	}
+	Print(constructcached);
+
+	// full rendering into a 720p offscreen buffer, drawing centered
+	const int width = 1280, height = 720;
+	std::vector<agg::int8u> pixels(width * height * BenchEngine::PixelFormat::AGGType::pix_width);
+	agg::rendering_buffer rbuf(&pixels[0], width, height, width * BenchEngine::PixelFormat::AGGType::pix_width);
+	const double zooms[] = { 0.25, 1.0, 4.0 };
+	const char *zoomnames[] = { "Render_zoom_0.25", "Render_zoom_1", "Render_zoom_4" };
+	for (int z = 0; z < 3; z++)
+	{
+		engine._PointSystem()->Set(zooms[z], width / 2, height / 2);
+		BenchResult render(zoomnames[z], ncmds);
+		for (int i = 0; i < runs; i++)
+		{
+			Start();
+			engine.Render(rbuf);
+			Stop(render);
+		}
+		render.vertices = engine.CountVertices();
+		render.spline_error = engine.SplineError();
+		if (engine.curve_quality > 0 && render.spline_error > 1.0 / engine.curve_quality)
+		{
+			fprintf(stderr, "assdraw_bench: %s flattens splines %.4f pixels off, more than 1/%d\n", zoomnames[z], render.spline_error, engine.curve_quality);
+			failed = true;
+		}
+		int quality = engine.curve_quality;
+		engine.curve_quality = 0;
+		render.vertices_saved = (long) engine.CountVertices() - (long) render.vertices;
+		engine.curve_quality = quality;
+		Print(render);
+	}
+	engine._PointSystem()->Set(1.0, width / 2, height / 2);
+
+	// what a dirty rectangle repaint costs, e.g. for the hover ring of one point
+	agg::rect_i dirtyrect(width / 2 - 32, height / 2 - 32, width / 2 + 31, height / 2 + 31);
+	BenchResult renderclipped("Render_clipped_64x64", ncmds);
+	for (int i = 0; i < runs; i++)
+	{
+		Start();
+		engine.Render(rbuf, &dirtyrect);
+		Stop(renderclipped);
+	}
+	Print(renderclipped);
+
+	// lookups of existing coordinates, one every ncmds / lookups commands
+	const size_t lookups = 100;
+	std::vector<wxPoint> mainpts, ctrlpts;
+	size_t n = 0;
+	for (DrawCmdList::iterator it = engine.Iterator(); it != engine.IteratorEnd(); it++, n++)
+	{
+		if (n % (ncmds / lookups + 1) != 0)
+			continue;
+		mainpts.push_back(wxPoint((*it)->m_point->x(), (*it)->m_point->y()));
+		if (!(*it)->controlpoints.empty())
+			ctrlpts.push_back(wxPoint((*it)->controlpoints.front()->x(), (*it)->controlpoints.front()->y()));
+	}
+	BenchResult pointat("PointAt", ncmds, mainpts.size());
+	BenchResult controlat("ControlAt", ncmds, ctrlpts.size());
+	for (int i = 0; i < runs; i++)
+	{
+		Start();
+		for (size_t j = 0; j < mainpts.size(); j++)
+			engine.PointAt(mainpts[j].x, mainpts[j].y);
+		Stop(pointat);
+
+		Point *pnt;
+		Start();
+		for (size_t j = 0; j < ctrlpts.size(); j++)
+			engine.ControlAt(ctrlpts[j].x, ctrlpts[j].y, pnt);
+		Stop(controlat);
+	}
+	Print(pointat);
+	Print(controlat);
+
+	// select the middle of the drawing, then add to and remove from the selection
+	BenchResult select("SelectPointsWithin", ncmds, 3);
+	for (int i = 0; i < runs; i++)
+	{
+		PointSet selection;
+		Start();
+		engine.SelectPointsWithin(selection, width / 2 - 500, width / 2 + 500, height / 2 - 500, height / 2 + 500, NEW);
+		engine.SelectPointsWithin(selection, width / 2 - 800, width / 2, height / 2 - 800, height / 2, ADD);
+		engine.SelectPointsWithin(selection, width / 2 - 100, width / 2 + 100, height / 2 - 100, height / 2 + 100, DEL);
+		Stop(select);
+		engine.SelectPointsWithin(selection, 0, -1, 0, -1, NEW);
+	}
+	Print(select);
+
+	// insert commands after the middle one and delete them again, one by one and all at once
+	const size_t edits = 100;
+	DrawCmd *middle = NULL;
+	n = 0;
+	for (DrawCmdList::iterator it = engine.Iterator(); it != engine.IteratorEnd() && n <= ncmds / 2; it++, n++)
+		middle = *it;
+	BenchResult insert("InsertCmd", ncmds, edits);
+	BenchResult del("DeleteCommand", ncmds, edits);
+	BenchResult bulkdel("DeleteCommands", ncmds, edits);
+	for (int i = 0; i < runs; i++)
+	{
+		std::vector<DrawCmd*> added;
+		Start();
+		for (size_t j = 0; j < edits; j++)
+		{
+			added.push_back(engine.NewCmd(L, (int) j, (int) j));
+			engine.InsertCmd(added.back(), middle);
+		}
+		Stop(insert);
+
+		Start();
+		for (size_t j = 0; j < edits; j++)
+			engine.DeleteCommand(added[j]);
+		Stop(del);
+
+		DrawCmdSet todelete;
+		for (size_t j = 0; j < edits; j++)
+		{
+			DrawCmd *cmd = engine.NewCmd(L, (int) j, (int) j);
+			engine.InsertCmd(cmd, middle);
+			todelete.insert(cmd);
+		}
+		Start();
+		engine.DeleteCommands(todelete);
+		Stop(bulkdel);
+	}
+	Print(insert);
+	Print(del);
+	Print(bulkdel);
+
+	// rotate by 10 degrees back and forth
+	BenchResult transform("Transform", ncmds);
+	const float c = cos(0.1745f), s = sin(0.1745f);
+	for (int i = 0; i < runs; i++)
+	{
+		Start();
+		if (i % 2)
+			engine.Transform(c, s, -s, c, 0, 0, 0, 0);
+		else
+			engine.Transform(c, -s, s, c, 0, 0, 0, 0);
+		Stop(transform);
+	}
+	Print(transform);
+
+	// what ASSDrawCanvas::UpdateNonUniformTransformation does for every mouse move in
+	// bilinear transformation mode: skew the bounding box from the backed up points
+	agg::path_storage backup;
+	engine.BackupPoints(backup);
+	double x1 = width / 2 - 1000, y1 = height / 2 - 1000, x2 = width / 2 + 1000, y2 = height / 2 + 1000;
+	double quad[8] = { x1 + 100, y1, x2, y1 + 50, x2 - 30, y2, x1, y2 - 80 };
+	BenchResult bilinear("UpdateNonUniformTransformation", ncmds);
+	for (int i = 0; i < runs; i++)
+	{
+		Start();
+		engine.TransformPointsBilinear(backup, x1, y1, x2, y2, quad);
+		Stop(bilinear);
+	}
+	Print(bilinear);
+}
+
+int main(int argc, char **argv)
+{
+	// wxBase only; everything is rendered offscreen
+	wxInitializer initializer(argc, argv);
+	if (!initializer.IsOk())
+	{
+		fprintf(stderr, "assdraw_bench: failed to initialize wxWidgets\n");
+		return 1;
+	}
+
+	bool json = false;
+	long runs = 3;
+	long threads = 1;
+	std::vector<unsigned long> sizes;
+	for (int i = 1; i < argc; i++)
+	{
+		wxString arg(argv[i], wxConvUTF8), value;
+		if (arg.StartsWith(_T("--format="), &value) && (value == _T("csv") || value == _T("json")))
+			json = value == _T("json");
+		else if (arg.StartsWith(_T("--runs="), &value) && value.ToLong(&runs) && runs > 0)
+			continue;
+		else if (arg.StartsWith(_T("--threads="), &value) && value.ToLong(&threads) && threads >= 0)
+			continue;
+		else if (arg.StartsWith(_T("--sizes="), &value))
+		{
+			wxStringTokenizer tkz(value, _T(","));
+			unsigned long size;
+			while (tkz.HasMoreTokens())
+				if (tkz.GetNextToken().ToULong(&size) && size > 0)
+					sizes.push_back(size);
+		}
+		else
+		{
+			fprintf(stderr, "usage: assdraw_bench [--format=csv|json] [--sizes=n,n,...] [--runs=n] [--threads=n]\n");
+			return 1;
+		}
+	}
+	if (sizes.empty())
+	{
+		sizes.push_back(1000);
+		sizes.push_back(10000);
+		sizes.push_back(100000);
+		sizes.push_back(1000000);
+	}
+
+	Bench bench(json, (int) runs, (int) threads);
+	bench.Begin();
+	bench.RunPixels();
+	bench.RunTallFill();
+	for (size_t i = 0; i < sizes.size(); i++)
+		bench.Run(sizes[i]);
+	return bench.End()? 0:1;
+}
@@ -34,9 +34,13 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 
 #include "canvas.hpp"
 #include "assdraw.hpp"
+#include "layerthread.hpp"
 
 #include <wx/image.h>
 #include <wx/filename.h>
@@ -46,6 +50,7 @@
 #include <agg_ellipse.h>
 #include <agg_conv_clip_polygon.h>
 #include <agg_trans_bilinear.h>
+#include <agg_bounding_rect.h>
 
 
 // ----------------------------------------------------------------------------
@@ -67,11 +72,13 @@ BEGIN_EVENT_TABLE(ASSDrawCanvas, ASSDrawEngine)
 	EVT_MENU(MENU_DRC_C1CONTBEZ, ASSDrawCanvas::OnSelect_C1ContinuityBezier)
 	EVT_MENU(MENU_DRC_MOVE00, ASSDrawCanvas::OnSelect_Move00Here)
 	EVT_MOUSE_CAPTURE_LOST(ASSDrawCanvas::CustomOnMouseCaptureLost)
+	EVT_TIMER(TIMER_DRAFT, ASSDrawCanvas::OnDraftTimer)
 END_EVENT_TABLE()
 
 ASSDrawCanvas::ASSDrawCanvas(wxWindow *parent, ASSDrawFrame *frame, int extraflags) : ASSDrawEngine(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, extraflags)
 {
 	m_frame = frame;
+	oldassrevision = 0;
 	preview_mode = false;
 	lastDrag_left = NULL;
 	lastDrag_right = NULL;
@@ -91,6 +98,37 @@ ASSDrawCanvas::ASSDrawCanvas(wxWindow *parent, ASSDrawFrame *frame, int extrafla
 	bgimg.bgimg = NULL;
 	bgimg.alpha = 0.5;
 	rectbound2upd = -1, rectbound2upd2 = -1;
+	scenehash = 0;
+	scene_originx = scene_originy = 0;
+	scene_bgbmp = NULL;
+	for (int l = 0; l < LAYER_COUNT; l++)
+	{
+		layers[l].width = layers[l].height = 0;
+		layers[l].draft = false;
+	}
+	for (int r = 0; r < RULER_COUNT; r++)
+	{
+		rulers[r].width = rulers[r].height = rulers[r].length = 0;
+		rulers[r].labelled = true;
+	}
+	draft = false;
+	draft_drag = true;
+	draft_curve_quality = 1;
+	draft_idle = 200;
+	draft_timer.SetOwner(this, TIMER_DRAFT);
+	markers_scale = 0;
+	layerjob_busy = false;
+	layerjob_dx = layerjob_dy = 0;
+	background_dx = background_dy = 0;
+	snapshot_revision = 0;
+	layerthread = new ShapeLayerThread(this);
+	if (layerthread->Create() != wxTHREAD_NO_ERROR || layerthread->Run() != wxTHREAD_NO_ERROR)
+	{
+		// then the shape layer is drawn along with the rest
+		delete layerthread;
+		layerthread = NULL;
+	}
+	Connect(wxEVT_SHAPELAYER_DONE, wxCommandEventHandler(ASSDrawCanvas::OnShapeLayerDone));
 
 	rgba_shape_normal = agg::rgba(0,0,1,0.5);
 	rgba_outline = agg::rgba(0,0,0);
@@ -112,6 +150,7 @@ ASSDrawCanvas::ASSDrawCanvas(wxWindow *parent, ASSDrawFrame *frame, int extrafla
 	::wxInitAllImageHandlers();
 	bgimg.bgbmp = NULL;
 	bgimg.bgimg = NULL;
+	bgimg.faded = NULL;
 	// drag image background file
 	SetDropTarget(new ASSDrawFileDropTarget(this));
 
@@ -138,16 +177,22 @@ ASSDrawCanvas::ASSDrawCanvas(wxWindow *parent, ASSDrawFrame *frame, int extrafla
 // Destructor
 ASSDrawCanvas::~ASSDrawCanvas()
 {
+	if (layerthread)
+	{
+		layerthread->Quit();
+		layerthread->Wait();
+		delete layerthread;
+	}
 	ASSDrawEngine::ResetEngine(false);
-	if (pointsys)
-		delete pointsys;
 	if (bgimg.bgbmp)
 		delete bgimg.bgbmp;
 	if (bgimg.bgimg)
 		delete bgimg.bgimg;
+	if (bgimg.faded)
+		bgimg.faded->Unref();
 }
 
-void ASSDrawCanvas::ParseASS(wxString str, bool addundo)
+void ASSDrawCanvas::ParseASS(const wxString& str, bool addundo)
 {
 	if (addundo)
 		AddUndo(_T("Modify drawing commands"));
@@ -187,16 +232,16 @@ void ASSDrawCanvas::SetPreviewMode(bool mode)
 	}
 }
 
-// (Re)draw canvas
-void ASSDrawCanvas::RefreshDisplay()
+void ASSDrawCanvas::PrepareFrame()
 {
-	ASSDrawEngine::RefreshDisplay();
 	wxString asscmds = GenerateASS();
-	if (oldasscmds != asscmds)
+	// the strings only need comparing if the drawing changed at all since the last time
+	if (oldassrevision != ASSRevision() && oldasscmds != asscmds)
 	{
 		m_frame->UpdateASSCommandStringToSrcTxtCtrl(asscmds);
 		oldasscmds = asscmds;
 	}
+	oldassrevision = ASSRevision();
 }
 
 void ASSDrawCanvas::SetDrawMode(MODE mode)
@@ -216,18 +261,7 @@ void ASSDrawCanvas::SetDrawMode(MODE mode)
 		{
 
 			// backup cmds
-			backupcmds.free_all();
-			for (DrawCmdList::iterator iterate = cmds.begin(); iterate != cmds.end(); iterate++)
-			{
-				DrawCmd* cmd = (*iterate);
-				for (PointList::iterator iterate2 = cmd->controlpoints.begin(); iterate2 != cmd->controlpoints.end(); iterate2++)
-				{
-					wxPoint pp = (*iterate2)->ToWxPoint();
-					backupcmds.move_to(pp.x, pp.y);
-				}
-				wxPoint pp = (*iterate)->m_point->ToWxPoint();
-				backupcmds.move_to(pp.x, pp.y);
-			}
+			BackupPoints(backupcmds);
 
 			// calculate bounding rectangle
 			agg::trans_affine mtx;
@@ -275,6 +309,8 @@ void ASSDrawCanvas::OnMouseMove(wxMouseEvent &event)
 	pointsys->FromWxPoint(mouse_point, wx, wy);
 	if (event.Dragging())
 	{
+		if (capturemouse_left || capturemouse_right)
+			BeginDraft();
 		if (IsTransformMode() && isshapetransformable && backupowner == LEFT)
 		{
 			// update bounding polygon
@@ -374,7 +410,7 @@ void ASSDrawCanvas::OnMouseMove(wxMouseEvent &event)
 		{
 
 			// point left-dragged
-			if (mousedownAt_point != NULL && mousedownAt_point->isselected && !mousedownAt_point->IsAt(wx, wy))
+			if (mousedownAt_point != NULL && mousedownAt_point->IsSelected() && !mousedownAt_point->IsAt(wx, wy))
 			{
 				if (draw_mode == MODE_ARR)
 				{
@@ -651,6 +687,7 @@ void ASSDrawCanvas::ProcessOnMouseLeftUp()
 	if (HasCapture())
 		ReleaseMouse();
 	capturemouse_left = false;
+	EndDraft();
 
 	RefreshDisplay();
 }
@@ -720,12 +757,12 @@ void ASSDrawCanvas::OnMouseLeftDown(wxMouseEvent& event)
 	// we already calculated pointedAt_point in OnMouseMove() so just use it
 	mousedownAt_point = pointedAt_point;
 	SELECTMODE smode = GetSelectMode(event);
-	if (mousedownAt_point && !mousedownAt_point->isselected)
+	if (mousedownAt_point && !mousedownAt_point->IsSelected())
 	{
 		if (smode == NEW)
 		{
 			ClearPointsSelection();
-			mousedownAt_point->isselected = true;
+			mousedownAt_point->SetSelected(true);
 			selected_points.insert(mousedownAt_point);
 		}
 		else
@@ -779,6 +816,7 @@ void ASSDrawCanvas::ProcessOnMouseRightUp()
 	if (HasCapture())
 		ReleaseMouse();
 	capturemouse_right = false;
+	EndDraft();
 
 	rectbound2upd = -1;
 	rectbound2upd2 = -1;
@@ -997,7 +1035,7 @@ void ASSDrawCanvas::OnSelect_ConvertLineToBezier(wxCommandEvent&)
 	if (!dblclicked_point_right)
 		return;
 	AddUndo(_T("Convert Line to Bezier"));
-	DrawCmd_B *newB = new DrawCmd_B(dblclicked_point_right->x(), dblclicked_point_right->y(), pointsys, dblclicked_point_right->cmd_main);
+	DrawCmd_B *newB = new (pointsys) DrawCmd_B(dblclicked_point_right->x(), dblclicked_point_right->y(), pointsys, dblclicked_point_right->cmd_main);
 	InsertCmd(newB, dblclicked_point_right->cmd_main);
 	ClearPointsSelection();
 	SetHighlighted(NULL, NULL);
@@ -1013,7 +1051,7 @@ void ASSDrawCanvas::OnSelect_ConvertBezierToLine(wxCommandEvent&)
 	if (!dblclicked_point_right)
 		return;
 	AddUndo(_T("Convert Bezier to Line"));
-	DrawCmd_L *newL = new DrawCmd_L(dblclicked_point_right->x(), dblclicked_point_right->y(), pointsys, dblclicked_point_right->cmd_main);
+	DrawCmd_L *newL = new (pointsys) DrawCmd_L(dblclicked_point_right->x(), dblclicked_point_right->y(), pointsys, dblclicked_point_right->cmd_main);
 	InsertCmd(newL, dblclicked_point_right->cmd_main);
 	ClearPointsSelection();
 	SetHighlighted(NULL, NULL);
@@ -1094,7 +1132,7 @@ void ASSDrawCanvas::EnforceC1Continuity(DrawCmd* cmd, Point* pnt)
 // Undo/Redo system
 void ASSDrawCanvas::AddUndo(wxString desc)
 {
-	PrepareUndoRedo(_undo, false, _T(""), desc);
+	PrepareUndoRedo(_undo, false, desc);
 	undos.push_back(_undo);
 	// also empty redos
 	redos.clear();
@@ -1112,10 +1150,16 @@ bool ASSDrawCanvas::UndoOrRedo(bool isundo)
 	UndoRedo r = main->back();
 	// push into sub
 	UndoRedo nr(r);
-	PrepareUndoRedo(nr, true, GenerateASS(), r.desc);
+	PrepareUndoRedo(nr, true, r.desc);
 	sub->push_back(nr);
 	// parse
+#ifdef __WXDEBUG__
+	ResetAllocStats();
+#endif
 	r.Export(this);
+#ifdef __WXDEBUG__
+	wxLogDebug(_T("%s: %lu points/commands allocated, %lu memory chunks taken from the system"), isundo? _T("undo"):_T("redo"), AllocStats().allocs, AllocStats().chunks);
+#endif
 	// delete that
 	std::list<UndoRedo>::iterator iter = main->end();
 	iter--;
@@ -1147,9 +1191,9 @@ wxString ASSDrawCanvas::GetTopRedo()
 		return redos.back().desc;
 }
 
-void ASSDrawCanvas::PrepareUndoRedo(UndoRedo& ur, bool prestage, wxString cmds, wxString desc)
+void ASSDrawCanvas::PrepareUndoRedo(UndoRedo& ur, bool prestage, wxString desc)
 {
-	ur.Import(this, prestage, cmds);
+	ur.Import(this, prestage);
 	ur.desc = desc;
 }
 
@@ -1162,41 +1206,7 @@ void ASSDrawCanvas::SetHighlighted(DrawCmd* cmd, Point* point)
 
 int ASSDrawCanvas::SelectPointsWithin(int lx, int rx, int ty, int by, SELECTMODE smode)
 {
-
-	DrawCmdList::iterator iterate = cmds.begin();
-	for (; iterate != cmds.end(); iterate++)
-	{
-		wxPoint wx = (*iterate)->m_point->ToWxPoint();
-
-		if (wx.x >= lx && wx.x <= rx && wx.y >= ty && wx.y <= by)
-			(*iterate)->m_point->isselected = (smode != DEL);
-		else
-			(*iterate)->m_point->isselected &= (smode != NEW);
-
-		if ((*iterate)->m_point->isselected)
-			selected_points.insert((*iterate)->m_point);
-		else
-			selected_points.erase((*iterate)->m_point);
-
-		PointList::iterator pnt_iterator = (*iterate)->controlpoints.begin();
-		PointList::iterator end = (*iterate)->controlpoints.end();
-		for (; pnt_iterator != end; pnt_iterator++)
-		{
-			wxPoint wx = (*pnt_iterator)->ToWxPoint();
-
-			if (wx.x >= lx && wx.x <= rx && wx.y >= ty && wx.y <= by)
-				(*pnt_iterator)->isselected = (smode != DEL);
-			else
-				(*pnt_iterator)->isselected &= (smode != NEW);
-
-			if ((*pnt_iterator)->isselected)
-				selected_points.insert(*pnt_iterator);
-			else
-				selected_points.erase(*pnt_iterator);
-		}
-	}
-
-	return selected_points.size();
+	return ASSDrawShape::SelectPointsWithin(selected_points, lx, rx, ty, by, smode);
 }
 
 void ASSDrawCanvas::ClearPointsSelection()
@@ -1205,7 +1215,7 @@ void ASSDrawCanvas::ClearPointsSelection()
 	{
 		PointSet::iterator piter = selected_points.begin();
 		for (; piter != selected_points.end(); piter++)
-			(*piter)->isselected = false;
+			(*piter)->SetSelected(false);
 		selected_points.clear();
 	}
 }
@@ -1222,315 +1232,1161 @@ SELECTMODE ASSDrawCanvas::GetSelectMode(wxMouseEvent& event)
 	return smode;
 }
 
-void ASSDrawCanvas::DoDraw(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx)
+// how far the ruler strips reach into the window; labels reaching further are cut off
+static const int RULER_H_THICKNESS = 24;
+static const int RULER_V_THICKNESS = 64;
+
+// FNV-1a, for telling whether anything on the canvas changed since the last refresh
+static unsigned long HashBytes(unsigned long h, const void* data, size_t len)
 {
-	Draw_Clear(rbase);
-	int ww, hh; GetClientSize(&ww, &hh);
+	const unsigned char* p = (const unsigned char*) data;
+	for (size_t i = 0; i < len; i++)
+		h = ((h ^ p[i]) * 16777619UL) & 0xFFFFFFFFUL;
+	return h;
+}
 
-	if (bgimg.bgbmp)
-	{
-		rasterizer.reset();
-		interpolator_type interpolator(bgimg.img_mtx);
-		PixelFormat::AGGType ipixfmt(bgimg.ibuf);
-		span_gen_type spangen(ipixfmt, agg::rgba_pre(0, 0, 0, 1), interpolator);
-		ConvTrans bg_border(bgimg.bg_path, bgimg.path_mtx);
-		agg::conv_clip_polygon<ConvTrans> bg_clip(bg_border);
-		bg_clip.clip_box(0, 0, ww, hh);
-		rasterizer.add_path(bg_clip);
-		agg::render_scanlines_aa(rasterizer, scanline, rbase, bgimg.spanalloc, spangen);
-	}
+static unsigned long HashInt(unsigned long h, int v)
+{
+	return HashBytes(h, &v, sizeof(v));
+}
 
-	Draw_Draw(rbase, rprim, rsolid, mtx, preview_mode? rgba_shape:rgba_shape_normal);
+static unsigned long HashDouble(unsigned long h, double v)
+{
+	return HashBytes(h, &v, sizeof(v));
+}
 
-	if (!preview_mode)
+static unsigned long HashRGBA(unsigned long h, const agg::rgba& c)
+{
+	h = HashDouble(h, c.r);
+	h = HashDouble(h, c.g);
+	h = HashDouble(h, c.b);
+	return HashDouble(h, c.a);
+}
+
+static void GrowFootprint(double& x1, double& y1, double& x2, double& y2, double x, double y)
+{
+	if (x < x1) x1 = x;
+	if (y < y1) y1 = y;
+	if (x > x2) x2 = x;
+	if (y > y2) y2 = y;
+}
+
+// split a move into whole pixels dx, dy; false if it isn't one
+static bool WholePixels(double x, double y, int& dx, int& dy)
+{
+	dx = (int) floor(x + 0.5);
+	dy = (int) floor(y + 0.5);
+	return fabs(x - dx) < 1e-6 && fabs(y - dy) < 1e-6;
+}
+
+// whether one of rects takes in all of r
+static bool CoveredBy(const wxRect& r, const std::vector<wxRect>& rects)
+{
+	for (size_t i = 0; i < rects.size(); i++)
+		if (rects[i].Contains(r))
+			return true;
+	return false;
+}
+
+// reset the rows and columns that scrolling buf by dx, dy has brought into view to color
+static void ClearScrolledIn(agg::rendering_buffer& buf, int dx, int dy, const ASSDrawRenderer::PixelFormat::AGGType::color_type& color)
+{
+	ASSDrawRenderer::PixelFormat::AGGType pixf(buf);
+	agg::renderer_base<ASSDrawRenderer::PixelFormat::AGGType> rbase(pixf);
+	const int w = buf.width(), h = buf.height();
+	if (dx > 0)
+		rbase.copy_bar(0, 0, dx - 1, h - 1, color);
+	else if (dx < 0)
+		rbase.copy_bar(w + dx, 0, w - 1, h - 1, color);
+	if (dy > 0)
+		rbase.copy_bar(0, 0, w - 1, dy - 1, color);
+	else if (dy < 0)
+		rbase.copy_bar(0, h + dy, w - 1, h - 1, color);
+}
+
+// box filter the w by h pixels of pw bytes at src down to w / 2 by h / 2 at dst
+static void HalvePixels(const agg::int8u* src, unsigned w, unsigned h, unsigned pw, agg::int8u* dst)
+{
+	const unsigned hw = w / 2, hh = h / 2;
+	for (unsigned y = 0; y < hh; y++)
 	{
-		// [0, 0]
-		rasterizer.reset();
-		agg::path_storage org_path;
-		org_path.move_to(0, m_frame->sizes.origincross);
-		org_path.line_to(0, -m_frame->sizes.origincross);
-		org_path.move_to(m_frame->sizes.origincross, 0);
-		org_path.line_to(-m_frame->sizes.origincross, 0);
-		ConvTransAffine org_path_t(org_path, mtx);
-		ConvCurveTransAffine crosshair(org_path_t);
-		agg::conv_stroke<ConvCurveTransAffine> chstroke(crosshair);
-		rasterizer.add_path(chstroke);
-		rsolid.color(rgba_origin);
-		render_scanlines(rsolid, false);
+		const agg::int8u* r0 = src + 2 * y * w * pw;
+		const agg::int8u* r1 = r0 + w * pw;
+		agg::int8u* d = dst + y * hw * pw;
+		for (unsigned x = 0; x < hw; x++, r0 += 2 * pw, r1 += 2 * pw, d += pw)
+			for (unsigned i = 0; i < pw; i++)
+				d[i] = (agg::int8u) ((r0[i] + r0[i + pw] + r1[i] + r1[i + pw] + 2) >> 2);
+	}
+}
 
-		if (IsTransformMode() && isshapetransformable)
+void ASSDrawCanvas::CollectDamage()
+{
+	CollectCmdFootprints(newfootprints);
+	CollectOverlayRects(newoverlays, newfootprints);
+	unsigned long hash = SceneHash();
+
+	// the background layer is scrolled along with the view if the background image moved the
+	// same whole pixels (or there isn't one: a plain background looks the same anywhere)
+	int ww, hh;
+	GetClientSize(&ww, &hh);
+	int dx = 0, dy = 0, bgdx = 0, bgdy = 0;
+	bool pan = WholePixels(pointsys->originx - scene_originx, pointsys->originy - scene_originy, dx, dy)
+		&& abs(dx) < ww && abs(dy) < hh;
+	bool bgpan = bgimg.bgbmp == scene_bgbmp;
+	if (bgpan && bgimg.bgbmp)
+	{
+		const agg::trans_affine& m = bgimg.path_mtx;
+		bgpan = m.sx == scene_bgmtx.sx && m.shy == scene_bgmtx.shy && m.shx == scene_bgmtx.shx && m.sy == scene_bgmtx.sy
+			&& WholePixels(m.tx - scene_bgmtx.tx, m.ty - scene_bgmtx.ty, bgdx, bgdy);
+	}
+	else if (bgpan)
+		bgdx = dx, bgdy = dy;
+
+	if (hash != scenehash || !pan || !bgpan || ((bgdx || bgdy) && (bgdx != dx || bgdy != dy)))
+		InvalidateLayer(LAYER_BACKGROUND);
+	else if ((dx || dy) && bgdx == 0 && bgdy == 0 && bgimg.bgbmp)
+		// the drawing moved over a background image that stayed put
+		InvalidateLayer(LAYER_SHAPE);
+	else
+	{
+		if (dx || dy)
 		{
-			if (draw_mode == MODE_SCALEROTATE)
+			ScrollLayers(dx, dy);
+			// the rulers don't scroll with the rest, and the overlays are drawn again
+			// wherever they have been scrolled to
+			wxRect rulers[2] = { wxRect(0, 0, ww, RULER_H_THICKNESS), wxRect(0, 0, RULER_V_THICKNESS, hh) };
+			for (int i = 0; i < 2; i++)
 			{
-				// rotation centerpoint
-				rasterizer.reset();
-				double len = 10.0;
-				org_path.free_all();
-				org_path.move_to(rectcenter.x - len, rectcenter.y - len);
-				org_path.line_to(rectcenter.x + len, rectcenter.y + len);
-				org_path.move_to(rectcenter.x + len, rectcenter.y - len);
-				org_path.line_to(rectcenter.x - len, rectcenter.y + len);
-				agg::conv_stroke<agg::path_storage> cstroke(org_path);
-				rasterizer.add_path(cstroke);
-				agg::ellipse circ(rectcenter.x, rectcenter.y, len, len);
-				agg::conv_stroke<agg::ellipse> c(circ);
-				rasterizer.add_path(c);
-				rsolid.color(rgba_origin);
-				render_scanlines(rsolid, false);
+				invalidate(rulers[i]);
+				rulers[i].Offset(dx, dy);
+				invalidate(rulers[i]);
 			}
+			for (size_t i = 0; i < overlays.size(); i++)
+				overlays[i].Offset(dx, dy);
+		}
 
-			rasterizer.reset();
-			agg::path_storage org_path;
-			org_path.move_to(rectbound2[0].x, rectbound2[0].y);
-			org_path.line_to(rectbound2[1].x, rectbound2[1].y);
-			org_path.line_to(rectbound2[2].x, rectbound2[2].y);
-			org_path.line_to(rectbound2[3].x, rectbound2[3].y);
-			org_path.line_to(rectbound2[0].x, rectbound2[0].y);
-			agg::conv_stroke<agg::path_storage> chstroke(org_path);
-			chstroke.width(1);
-			rsolid.color(rgba_origin);
-			rasterizer.add_path(chstroke);
-			if (rectbound2upd != -1)
-			{
-				agg::ellipse circ(rectbound2[rectbound2upd].x, rectbound2[rectbound2upd].y, pointsys->scale, pointsys->scale);
-				agg::conv_contour< agg::ellipse > c(circ);
-				rasterizer.add_path(c);
-			}
-			if (rectbound2upd2 != -1)
-			{
-				agg::ellipse circ(rectbound2[rectbound2upd2].x, rectbound2[rectbound2upd2].y, pointsys->scale, pointsys->scale);
-				agg::conv_contour< agg::ellipse > c(circ);
-				rasterizer.add_path(c);
-			}
-			render_scanlines(rsolid, false);
+		// a changed command repaints where it was and where it is now, including
+		// whatever lies between (that's where the fill changed), plus its point markers
+		int pad = (int) ceil(pointsys->scale / 2.0) + 4;
+		size_t n = std::max(footprints.size(), newfootprints.size());
+		for (size_t i = 0; i < n; i++)
+		{
+			CmdFootprint none;
+			const CmdFootprint& o = i < footprints.size()? footprints[i]:none;
+			const CmdFootprint& c = i < newfootprints.size()? newfootprints[i]:none;
+			if (o.hash == c.hash)
+				continue;
+			if (o.hash && c.hash)
+				InvalidateLayer(LAYER_SHAPE, DrawingToWxRect(std::min(o.x1, c.x1), std::min(o.y1, c.y1), std::max(o.x2, c.x2), std::max(o.y2, c.y2), pad));
+			else if (o.hash)
+				InvalidateLayer(LAYER_SHAPE, DrawingToWxRect(o.x1, o.y1, o.x2, o.y2, pad));
+			else
+				InvalidateLayer(LAYER_SHAPE, DrawingToWxRect(c.x1, c.y1, c.x2, c.y2, pad));
+		}
+
+		if (overlays != newoverlays)
+		{
+			for (size_t i = 0; i < overlays.size(); i++)
+				invalidate(overlays[i]);
+			for (size_t i = 0; i < newoverlays.size(); i++)
+				invalidate(newoverlays[i]);
+		}
+	}
+
+	footprints.swap(newfootprints);
+	overlays.swap(newoverlays);
+	scenehash = hash;
+	scene_originx = pointsys->originx;
+	scene_originy = pointsys->originy;
+	scene_bgbmp = bgimg.bgbmp;
+	scene_bgmtx = bgimg.path_mtx;
+}
+
+void ASSDrawCanvas::ScrollLayers(int dx, int dy)
+{
+	int ww, hh;
+	GetClientSize(&ww, &hh);
+	for (int l = 0; l < LAYER_COUNT; l++)
+	{
+		// not the size of the window yet, and drawn all over again when it is
+		if (layers[l].width != ww || layers[l].height != hh)
+			continue;
+		// layerthread's background layer is scrolled with the next job
+		if (l == LAYER_BACKGROUND && layerthread)
+			background_dx += dx, background_dy += dy;
+		else
+			scrollBuffer(layers[l].rbuf, dx, dy);
+		scrollRects(layers[l].dirty, dx, dy, ww, hh);
+		// what comes into view of the shape layer waits for layerthread, but the points
+		// layer is drawn over it before that: make it the canvas colour, not old rows
+		if (l == LAYER_SHAPE && layerthread)
+			ClearScrolledIn(layers[l].rbuf, dx, dy, color_bg);
+	}
+	// the snapshot being drawn has to be scrolled the same when it's done, and the spare
+	// pixels of the shape layer now if they're not being drawn over
+	if (layerjob_busy)
+		layerjob_dx += dx, layerjob_dy += dy;
+	else if (!layer_spare.empty() && layer_spare.size() == layers[LAYER_SHAPE].pixels.size()
+		&& layers[LAYER_SHAPE].width == ww && layers[LAYER_SHAPE].height == hh)
+	{
+		agg::rendering_buffer sbuf(&layer_spare[0], ww, hh, ww * PixelFormat::AGGType::pix_width);
+		scrollBuffer(sbuf, dx, dy);
+		scrollRects(spare_stale, dx, dy, ww, hh);
+	}
+	scroll(dx, dy);
+}
+
+void ASSDrawCanvas::SubmitShapeLayer()
+{
+	int w = layers[LAYER_SHAPE].width, h = layers[LAYER_SHAPE].height;
+	if (layerjob_busy || w == 0 || h == 0)
+		return;
+
+	ShapeLayerJob* job = new ShapeLayerJob;
+	if (snapshot_revision != pointsys->store.revision || snapshot.empty())
+	{
+		GenerateBinary(snapshot);
+		snapshot_revision = pointsys->store.revision;
+	}
+	job->cmds = snapshot;
+	job->scale = pointsys->scale;
+	job->originx = pointsys->originx;
+	job->originy = pointsys->originy;
+	job->curve_quality = draft? draft_curve_quality:curve_quality;
+	job->fill_threads = fill_threads;
+	job->reduce = draft? 2:1;
+	job->fill = preview_mode? rgba_shape:rgba_shape_normal;
+	job->guideline = rgba_guideline;
+	job->outline = rgba_outline;
+	job->outlines = !preview_mode && !(IsTransformMode() && isshapetransformable);
+	job->width = w;
+	job->height = h;
+	job->dirty.swap(layers[LAYER_SHAPE].dirty);
+
+	// the layer as it is where it isn't to be drawn again; the spare pixels are the layer
+	// as it was before the last job, so they only need what that changed copied over, and
+	// not even that where it's all drawn again
+	if (layer_spare.size() != layers[LAYER_SHAPE].pixels.size())
+	{
+		layer_spare.resize(layers[LAYER_SHAPE].pixels.size());
+		spare_stale.assign(1, wxRect(0, 0, w, h));
+	}
+	job->pixels.swap(layer_spare);
+	agg::rendering_buffer jbuf(&job->pixels[0], w, h, w * PixelFormat::AGGType::pix_width);
+	PixelFormat::AGGType jpixf(jbuf);
+	RendererBase jbase(jpixf);
+	for (size_t i = 0; i < spare_stale.size(); i++)
+	{
+		const wxRect& r = spare_stale[i];
+		if (CoveredBy(r, job->dirty))
+			continue;
+		agg::rect_i clip(r.x, r.y, r.GetRight(), r.GetBottom());
+		jbase.copy_from(layers[LAYER_SHAPE].rbuf, &clip, 0, 0);
+	}
+	spare_stale.clear();
+
+	// and the background layer, which layerthread keeps
+	job->bgdx = background_dx;
+	job->bgdy = background_dy;
+	background_dx = background_dy = 0;
+	job->bgdirty.swap(layers[LAYER_BACKGROUND].dirty);
+	job->bgcolor = color_bg;
+	if (bgimg.faded)
+	{
+		job->bgimage = bgimg.faded->Ref();
+		job->bglevel = BackgroundLevel(job->bgimage_mtx);
+		job->bgpath = bgimg.bg_path;
+		job->bgpath_mtx = bgimg.path_mtx;
+		job->bgdraft = draft;
+		layers[LAYER_BACKGROUND].draft |= draft && !job->bgdirty.empty();
+	}
+
+	layerjob_busy = true;
+	layerjob_dx = layerjob_dy = 0;
+	layers[LAYER_SHAPE].draft |= draft;
+	layerthread->Submit(job);
+}
+
+void ASSDrawCanvas::OnShapeLayerDone(wxCommandEvent& WXUNUSED(event))
+{
+	ShapeLayerJob* job = layerthread? layerthread->Take():NULL;
+	if (job == NULL)
+		return;
+	layerjob_busy = false;
+
+	// if the window was resized meanwhile, the layer is being drawn all over again anyway
+	int w = layers[LAYER_SHAPE].width, h = layers[LAYER_SHAPE].height;
+	if (job->width == w && job->height == h)
+	{
+		layers[LAYER_SHAPE].pixels.swap(job->pixels);
+		layers[LAYER_SHAPE].rbuf.attach(&layers[LAYER_SHAPE].pixels[0], w, h, w * PixelFormat::AGGType::pix_width);
+		scrollBuffer(layers[LAYER_SHAPE].rbuf, layerjob_dx, layerjob_dy);
+		ClearScrolledIn(layers[LAYER_SHAPE].rbuf, layerjob_dx, layerjob_dy, color_bg);
+		// the pixels the layer had become the spare ones, which have been scrolled along
+		// already and only lack what was drawn
+		wxRect all(0, 0, w, h);
+		for (size_t i = 0; i < job->dirty.size(); i++)
+		{
+			wxRect r(job->dirty[i]);
+			r.Offset(layerjob_dx, layerjob_dy);
+			r.Intersect(all);
+			InvalidateLayer(LAYER_POINTS, r);
+			mergeRect(spare_stale, r);
+		}
+	}
+	layer_spare.swap(job->pixels);
+	delete job;
+	// and go on with whatever went out of date while this was being drawn
+	for (size_t i = 0; i < layers[LAYER_SHAPE].dirty.size(); i++)
+		invalidate(layers[LAYER_SHAPE].dirty[i]);
+	RefreshDisplay();
+}
+
+void ASSDrawCanvas::CollectCmdFootprints(std::vector<CmdFootprint>& fps)
+{
+	fps.assign(pointsys->store.CmdHandles(), CmdFootprint());
+
+	// where the path is so far, and where the current subpath started (the fill closes it there)
+	int lastx = 0, lasty = 0, startx = 0, starty = 0;
+	DrawCmdList::iterator ci = cmds.begin();
+	while (ci != cmds.end())
+	{
+		DrawCmd* cmd = *ci;
+		ci++;
+		bool closes = ci == cmds.end() || (*ci)->type == M;
+		bool isM = cmd->type == M;
+		int mx = cmd->m_point->x(), my = cmd->m_point->y();
+
+		unsigned long h = 2166136261UL;
+		h = HashInt(h, cmd->type);
+		h = HashInt(h, cmd->initialized);
+		if (!isM)
+		{
+			h = HashInt(h, lastx);
+			h = HashInt(h, lasty);
+		}
+		h = HashInt(h, mx);
+		h = HashInt(h, my);
+		for (PointList::iterator pi = cmd->controlpoints.begin(); pi != cmd->controlpoints.end(); pi++)
+		{
+			h = HashInt(h, (*pi)->x());
+			h = HashInt(h, (*pi)->y());
+		}
+		if (isM)
+			startx = mx, starty = my;
+		if (closes)
+		{
+			h = HashInt(h, startx);
+			h = HashInt(h, starty);
+		}
+
+		unsigned int handle = cmd->Handle();
+		CmdFootprint& fp = fps[handle];
+		fp.hash = h? h:1;
+		if (handle < footprints.size() && footprints[handle].hash == fp.hash)
+		{
+			// unchanged, so is the bounding box
+			fp = footprints[handle];
 		}
 		else
 		{
-			// outlines
-			agg::conv_stroke<ConvTrans> bguidestroke(*rb_path);
-			bguidestroke.width(1);
-			rsolid.color(rgba_guideline);
-			rasterizer.add_path(bguidestroke);
-			render_scanlines(rsolid);
-
-			agg::conv_stroke<ConvCurveTransAffine> stroke(*rm_curve);
-			stroke.width(1);
-			rsolid.color(rgba_outline);
-			rasterizer.add_path(stroke);
-			render_scanlines(rsolid);
-
-			double diameter = pointsys->scale;
-			double radius = diameter / 2.0;
-			// hilite
-			if (hilite_cmd && hilite_cmd->type != M)
+			fp.x1 = fp.x2 = mx;
+			fp.y1 = fp.y2 = my;
+			if (!isM)
+				GrowFootprint(fp.x1, fp.y1, fp.x2, fp.y2, lastx, lasty);
+			if (closes)
+				GrowFootprint(fp.x1, fp.y1, fp.x2, fp.y2, startx, starty);
+			// a B curve stays inside its control points, but S splines may overshoot them
+			for (PointList::iterator pi = cmd->controlpoints.begin(); pi != cmd->controlpoints.end(); pi++)
+				GrowFootprint(fp.x1, fp.y1, fp.x2, fp.y2, (*pi)->x(), (*pi)->y());
+			if (cmd->type == S)
 			{
-				rasterizer.reset();
-				agg::path_storage h_path;
-				AddDrawCmdToAGGPathStorage(hilite_cmd, h_path, HILITE);
-				ConvTransAffine h_path_trans(h_path, mtx);
-				ConvCurveTransAffine curve(h_path_trans);
-				ConvDashCurveTransAffine d(curve);
-				d.add_dash(10,5);
-				agg::conv_stroke<ConvDashCurveTransAffine> stroke(d);
-				stroke.width(3);
-				rsolid.color(rgba_outline);
-				rasterizer.add_path(stroke);
-				render_scanlines(rsolid);
+				agg::path_storage path;
+				AddDrawCmdToAGGPathStorage(cmd, path);
+				double x1, y1, x2, y2;
+				if (agg::bounding_rect_single(path, 0, &x1, &y1, &x2, &y2))
+				{
+					GrowFootprint(fp.x1, fp.y1, fp.x2, fp.y2, x1, y1);
+					GrowFootprint(fp.x1, fp.y1, fp.x2, fp.y2, x2, y2);
+				}
 			}
+		}
 
-			// m_point
-			rasterizer.reset();
-			DrawCmdList::iterator ci = cmds.begin();
-			while (ci != cmds.end())
+		// an uninitialized B isn't in the path yet
+		if (cmd->type != B || cmd->initialized)
+			lastx = mx, lasty = my;
+	}
+}
+
+void ASSDrawCanvas::CollectOverlayRects(std::vector<wxRect>& rects, std::vector<CmdFootprint>& fps)
+{
+	rects.clear();
+	if (preview_mode)
+		return;
+
+	double scale = pointsys->scale;
+	int radius = (int) ceil(scale / 2.0);
+
+	if (IsTransformMode())
+	{
+		if (!isshapetransformable)
+			return;
+		double x1 = rectcenter.x, y1 = rectcenter.y, x2 = rectcenter.x, y2 = rectcenter.y;
+		for (int i = 0; i < 4; i++)
+			GrowFootprint(x1, y1, x2, y2, rectbound2[i].x, rectbound2[i].y);
+		int pad = (int) ceil(scale) + 12;
+		rects.push_back(wxRect(wxPoint((int) floor(x1) - pad, (int) floor(y1) - pad), wxPoint((int) ceil(x2) + pad, (int) ceil(y2) + pad)));
+		// the grabbed corners
+		int upd[2] = { rectbound2upd, rectbound2upd2 };
+		for (int i = 0; i < 2; i++)
+		{
+			if (upd[i] != -1)
 			{
-				double lx = (*ci)->m_point->x() * pointsys->scale + pointsys->originx - radius;
-				double ty = (*ci)->m_point->y() * pointsys->scale + pointsys->originy - radius;
-				agg::path_storage sqp = agghelper::RectanglePath(lx, lx + diameter, ty, ty + diameter);
-				agg::conv_contour<agg::path_storage> c(sqp);
-				rasterizer.add_path(c);
-				ci++;
+				wxRealPoint& p = rectbound2[upd[i]];
+				rects.push_back(wxRect((int) p.x - pad, (int) p.y - pad, pad * 2 + 1, pad * 2 + 1));
 			}
-			render_scanlines_aa_solid(rbase, rgba_mainpoint);
+		}
+		return;
+	}
+
+	int ww, hh;
+	GetClientSize(&ww, &hh);
 
-			// control_points
+	if (hilite_cmd && hilite_cmd->type != M && hilite_cmd->Handle() < fps.size())
+	{
+		const CmdFootprint& fp = fps[hilite_cmd->Handle()];
+		rects.push_back(DrawingToWxRect(fp.x1, fp.y1, fp.x2, fp.y2, 4));
+	}
+
+	// selection rings
+	int ring = radius + 5;
+	PointSet::iterator si = selected_points.begin();
+	for (; si != selected_points.end(); si++)
+	{
+		int cx = (int) floor((*si)->x() * scale + pointsys->originx);
+		int cy = (int) floor((*si)->y() * scale + pointsys->originy);
+		rects.push_back(wxRect(cx - ring, cy - ring, ring * 2 + 2, ring * 2 + 2));
+	}
+
+	// hover: ring, coordinates and the dashed crosshair
+	if (hilite_point)
+	{
+		int cx = (int) floor(hilite_point->x() * scale + pointsys->originx);
+		int cy = (int) floor(hilite_point->y() * scale + pointsys->originy);
+		ring = radius + 6;
+		rects.push_back(wxRect(cx - ring, cy - ring, ring * 2 + 2, ring * 2 + 2));
+
+		wxPoint pxy = hilite_point->ToWxPoint(true);
+		agg::gsv_text t;
+		t.flip(true);
+		t.size(8.0);
+		t.start_point(pxy.x + 5, pxy.y -5);
+		t.text(wxString::Format(_T("%d,%d"), hilite_point->x(), hilite_point->y()).mb_str(wxConvUTF8));
+		agg::conv_stroke<agg::gsv_text> pt(t);
+		pt.width(1.5);
+		double x1, y1, x2, y2;
+		if (agg::bounding_rect_single(pt, 0, &x1, &y1, &x2, &y2))
+			rects.push_back(wxRect(wxPoint((int) floor(x1) - 2, (int) floor(y1) - 2), wxPoint((int) ceil(x2) + 2, (int) ceil(y2) + 2)));
+
+		rects.push_back(wxRect(pxy.x - 2, 0, 5, hh));
+		rects.push_back(wxRect(0, pxy.y - 2, ww, 5));
+	}
+
+	// selection box, just its edges
+	if (lastDrag_left && dragAnchor_left)
+	{
+		int lx = std::min(lastDrag_left->x, dragAnchor_left->x), rx = std::max(lastDrag_left->x, dragAnchor_left->x);
+		int ty = std::min(lastDrag_left->y, dragAnchor_left->y), by = std::max(lastDrag_left->y, dragAnchor_left->y);
+		rects.push_back(wxRect(lx - 2, ty - 2, rx - lx + 5, 5));
+		rects.push_back(wxRect(lx - 2, by - 2, rx - lx + 5, 5));
+		rects.push_back(wxRect(lx - 2, ty - 2, 5, by - ty + 5));
+		rects.push_back(wxRect(rx - 2, ty - 2, 5, by - ty + 5));
+	}
+}
+
+unsigned long ASSDrawCanvas::SceneHash()
+{
+	int ww, hh;
+	GetClientSize(&ww, &hh);
+	unsigned long h = 2166136261UL;
+	h = HashDouble(h, pointsys->scale);
+	h = HashInt(h, ww);
+	h = HashInt(h, hh);
+	h = HashInt(h, preview_mode);
+	h = HashInt(h, draw_mode);
+	h = HashInt(h, IsTransformMode() && isshapetransformable);
+	h = HashInt(h, m_frame->sizes.origincross);
+	h = HashRGBA(h, rgba_shape);
+	h = HashRGBA(h, rgba_shape_normal);
+	h = HashRGBA(h, rgba_outline);
+	h = HashRGBA(h, rgba_guideline);
+	h = HashRGBA(h, rgba_mainpoint);
+	h = HashRGBA(h, rgba_controlpoint);
+	h = HashRGBA(h, rgba_selectpoint);
+	h = HashRGBA(h, rgba_origin);
+	h = HashRGBA(h, rgba_ruler_h);
+	h = HashRGBA(h, rgba_ruler_v);
+	h = HashBytes(h, &color_bg, sizeof(color_bg));
+	return h;
+}
+
+wxRect ASSDrawCanvas::DrawingToWxRect(double x1, double y1, double x2, double y2, int pad)
+{
+	double scale = pointsys->scale;
+	int l = (int) floor(x1 * scale + pointsys->originx) - pad;
+	int t = (int) floor(y1 * scale + pointsys->originy) - pad;
+	int r = (int) ceil(x2 * scale + pointsys->originx) + pad;
+	int b = (int) ceil(y2 * scale + pointsys->originy) + pad;
+	return wxRect(wxPoint(l, t), wxPoint(r, b));
+}
+
+void ASSDrawCanvas::BeginDraft()
+{
+	if (!draft_drag)
+		return;
+	draft = true;
+	// it's drawn properly if the mouse stays put for a while
+	if (draft_idle > 0)
+		draft_timer.Start(draft_idle, true);
+}
+
+void ASSDrawCanvas::EndDraft()
+{
+	draft_timer.Stop();
+	if (!draft)
+		return;
+	draft = false;
+
+	// the layers above a draft are drawn on top of a copy of it
+	for (int l = 0; l < LAYER_COUNT; l++)
+	{
+		if (!layers[l].draft)
+			continue;
+		InvalidateLayer((LAYER) l);
+		break;
+	}
+	for (int l = 0; l < LAYER_COUNT; l++)
+		layers[l].draft = false;
+	// UpdateRulers rasterizes them again with the labels
+	int ww, hh;
+	GetClientSize(&ww, &hh);
+	if (!rulers[RULER_H].labelled)
+		invalidate(wxRect(0, 0, ww, RULER_H_THICKNESS));
+	if (!rulers[RULER_V].labelled)
+		invalidate(wxRect(0, 0, RULER_V_THICKNESS, hh));
+	RefreshDisplay();
+}
+
+void ASSDrawCanvas::OnDraftTimer(wxTimerEvent& WXUNUSED(event))
+{
+	EndDraft();
+}
+
+void ASSDrawCanvas::InvalidateLayer(LAYER layer, const wxRect& rect)
+{
+	wxRect r(rect);
+	int ww, hh;
+	GetClientSize(&ww, &hh);
+	r.Intersect(wxRect(0, 0, ww, hh));
+	for (int l = layer; l < LAYER_COUNT; l++)
+		mergeRect(layers[l].dirty, r);
+	invalidate(r);
+}
+
+void ASSDrawCanvas::InvalidateLayer(LAYER layer)
+{
+	int ww, hh;
+	GetClientSize(&ww, &hh);
+	for (int l = layer; l < LAYER_COUNT; l++)
+	{
+		layers[l].dirty.clear();
+		layers[l].dirty.push_back(wxRect(0, 0, ww, hh));
+	}
+	invalidateAll();
+}
+
+void ASSDrawCanvas::UpdateLayers(RendererBase& rbase, agg::trans_affine& mtx)
+{
+	int w = rbase.width(), h = rbase.height();
+	for (int l = 0; l < LAYER_COUNT; l++)
+	{
+		if (layers[l].width == w && layers[l].height == h)
+			continue;
+		int stride = w * PixelFormat::AGGType::pix_width;
+		if (l == LAYER_BACKGROUND && layerthread)
+			// layerthread has the pixels
+			std::vector<agg::int8u>().swap(layers[l].pixels);
+		else
+			layers[l].pixels.resize(stride * h);
+		layers[l].rbuf.attach(layers[l].pixels.empty()? NULL:&layers[l].pixels[0], w, h, stride);
+		// the points layer is drawn over the shape layer before layerthread has drawn it at
+		// the new size, so until then it's the canvas colour
+		if (l == LAYER_SHAPE && layerthread && !layers[l].pixels.empty())
+		{
+			PixelFormat::AGGType pixf(layers[l].rbuf);
+			RendererBase lbase(pixf);
+			lbase.copy_bar(0, 0, w - 1, h - 1, color_bg);
+		}
+		layers[l].width = w;
+		layers[l].height = h;
+		layers[l].dirty.clear();
+		layers[l].dirty.push_back(wxRect(0, 0, w, h));
+	}
+
+	UpdateRulers(w, h);
+
+	if (layerthread && (!layers[LAYER_BACKGROUND].dirty.empty() || !layers[LAYER_SHAPE].dirty.empty()))
+		SubmitShapeLayer();
+	for (int l = layerthread? LAYER_POINTS:LAYER_BACKGROUND; l < LAYER_COUNT; l++)
+	{
+		if (layers[l].dirty.empty())
+			continue;
+		PixelFormat::AGGType pixf(layers[l].rbuf);
+		RendererBase lbase(pixf);
+		RendererPrimitives lprim(lbase);
+		RendererSolid lsolid(lbase);
+		for (size_t i = 0; i < layers[l].dirty.size(); i++)
+		{
+			const wxRect& r = layers[l].dirty[i];
+			agg::rect_i clip(r.x, r.y, r.GetRight(), r.GetBottom());
+			SetClip(lbase, &clip);
 			rasterizer.reset();
-			ci = cmds.begin();
-			while (ci != cmds.end())
+			if (l == LAYER_BACKGROUND)
+				DrawBackgroundLayer(lbase);
+			else
 			{
-				PointList::iterator pi = (*ci)->controlpoints.begin();
-				while (pi != (*ci)->controlpoints.end())
-				{
-					agg::ellipse circ((*pi)->x() * pointsys->scale + pointsys->originx, (*pi)->y() * pointsys->scale + pointsys->originy, radius, radius);
-					agg::conv_contour<agg::ellipse> c(circ);
-					rasterizer.add_path(c);
-					pi++;
-				}
-				ci++;
+				lbase.copy_from(layers[l - 1].rbuf, &clip, 0, 0);
+				if (l == LAYER_SHAPE)
+					DrawShapeLayer(lbase, lprim, lsolid, mtx);
+				else
+					DrawPointsLayer(lbase, lsolid, mtx);
 			}
-			render_scanlines_aa_solid(rbase, rgba_controlpoint);
+		}
+		layers[l].dirty.clear();
+	}
 
-			// selection
-			rasterizer.reset();
-			PointSet::iterator si = selected_points.begin();
-			while (si != selected_points.end())
+	// back to the part of the window being drawn
+	agg::rect_i clip(rbase.xmin(), rbase.ymin(), rbase.xmax(), rbase.ymax());
+	SetClip(rbase, &clip);
+	rasterizer.reset();
+}
+
+void ASSDrawCanvas::DoDraw(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx)
+{
+	UpdateLayers(rbase, mtx);
+
+	agg::rect_i area(rbase.xmin(), rbase.ymin(), rbase.xmax(), rbase.ymax());
+	rbase.copy_from(layers[LAYER_COUNT - 1].rbuf, &area, 0, 0);
+
+	if (!preview_mode)
+		DrawOverlays(rbase, rsolid, mtx);
+
+	DrawRulers(rbase);
+}
+
+void ASSDrawCanvas::DrawBackgroundLayer(RendererBase& rbase)
+{
+	Draw_Clear(rbase);
+
+	if (bgimg.faded)
+	{
+		agg::trans_affine img_mtx;
+		agg::rendering_buffer& ibuf = bgimg.faded->level[BackgroundLevel(img_mtx)];
+		RenderBackgroundImage(rbase, rasterizer, scanline, bgimg.spanalloc, ibuf, img_mtx, bgimg.bg_path, bgimg.path_mtx, draft);
+		if (draft)
+			layers[LAYER_BACKGROUND].draft = true;
+	}
+}
+
+size_t ASSDrawCanvas::BackgroundLevel(agg::trans_affine& img_mtx)
+{
+	// zoomed out, draw from the mip level that is shrunk no more than twice again on
+	// screen, so the filter still sees every pixel it skips over
+	const std::vector<agg::rendering_buffer>& levels = bgimg.faded->level;
+	size_t level = 0;
+	for (double s = bgimg.scale; s <= 0.5 && level + 1 < levels.size(); s *= 2)
+		level++;
+	img_mtx = bgimg.img_mtx;
+	if (level)
+		img_mtx *= agg::trans_affine_scaling((double) levels[level].width() / levels[0].width(), (double) levels[level].height() / levels[0].height());
+	return level;
+}
+
+void ASSDrawCanvas::RenderBackgroundImage(RendererBase& rbase, agg::rasterizer_scanline_aa<>& ras, agg::scanline_p8& sl, agg::span_allocator<color_type>& spanalloc,
+	agg::rendering_buffer& ibuf, const agg::trans_affine& img_mtx, agg::path_storage& path, const agg::trans_affine& path_mtx, bool draft)
+{
+	ras.reset();
+	interpolator_type interpolator(img_mtx);
+	PixelFormat::AGGType ipixfmt(ibuf);
+	ConvTrans bg_border(path, path_mtx);
+	agg::conv_clip_polygon<ConvTrans> bg_clip(bg_border);
+	// don't generate image spans outside the area being redrawn
+	bg_clip.clip_box(rbase.xmin(), rbase.ymin(), rbase.xmax() + 1, rbase.ymax() + 1);
+	ras.add_path(bg_clip);
+	if (draft)
+	{
+		// the nearest pixel instead of the four around it
+		img_accessor_type source(ipixfmt, agg::rgba_pre(0, 0, 0, 1));
+		span_gen_draft_type spangen(source, interpolator);
+		agg::render_scanlines_aa(ras, sl, rbase, spanalloc, spangen);
+	}
+	else
+	{
+		span_gen_type spangen(ipixfmt, agg::rgba_pre(0, 0, 0, 1), interpolator);
+		agg::render_scanlines_aa(ras, sl, rbase, spanalloc, spangen);
+	}
+}
+
+void ASSDrawCanvas::DrawShapeLayer(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx)
+{
+	Draw_Draw(rbase, rprim, rsolid, mtx, preview_mode? rgba_shape:rgba_shape_normal);
+
+	// the transform box takes the place of the outlines and points
+	if (!preview_mode && !(IsTransformMode() && isshapetransformable))
+		Draw_Outlines(rsolid, rgba_guideline, rgba_outline);
+}
+
+void ASSDrawCanvas::DrawPointsLayer(RendererBase& rbase, RendererSolid& rsolid, agg::trans_affine& mtx)
+{
+	if (preview_mode)
+		return;
+
+	// [0, 0]
+	rasterizer.reset();
+	agg::path_storage org_path;
+	org_path.move_to(0, m_frame->sizes.origincross);
+	org_path.line_to(0, -m_frame->sizes.origincross);
+	org_path.move_to(m_frame->sizes.origincross, 0);
+	org_path.line_to(-m_frame->sizes.origincross, 0);
+	ConvTransAffine org_path_t(org_path, mtx);
+	ConvCurveTransAffine crosshair(org_path_t);
+	agg::conv_stroke<ConvCurveTransAffine> chstroke(crosshair);
+	rasterizer.add_path(chstroke);
+	rsolid.color(rgba_origin);
+	render_scanlines(rsolid, false);
+
+	if (IsTransformMode() && isshapetransformable)
+		return;
+
+	PrepareMarkers();
+
+	// m_point
+	PixelFormat::AGGType::color_type color(rgba_mainpoint);
+	DrawCmdList::iterator ci = cmds.begin();
+	while (ci != cmds.end())
+	{
+		StampMarker(rbase, MARKER_MAIN, (*ci)->m_point, color);
+		ci++;
+	}
+
+	// control_points
+	color = PixelFormat::AGGType::color_type(rgba_controlpoint);
+	ci = cmds.begin();
+	while (ci != cmds.end())
+	{
+		PointList::iterator pi = (*ci)->controlpoints.begin();
+		while (pi != (*ci)->controlpoints.end())
+		{
+			StampMarker(rbase, MARKER_CONTROL, *pi, color);
+			pi++;
+		}
+		ci++;
+	}
+}
+
+// store the coverage ras has inside the width x height mask covers into it
+static void SweepCovers(agg::rasterizer_scanline_aa<>& ras, agg::int8u* covers, int width, int height)
+{
+	agg::scanline_u8 sl;
+	if (!ras.rewind_scanlines())
+		return;
+	sl.reset(ras.min_x(), ras.max_x());
+	while (ras.sweep_scanline(sl))
+	{
+		int y = sl.y();
+		if (y < 0 || y >= height)
+			continue;
+		unsigned num_spans = sl.num_spans();
+		agg::scanline_u8::const_iterator span = sl.begin();
+		for (;;)
+		{
+			for (int i = 0; i < span->len; i++)
 			{
-				agg::ellipse circ((*si)->x() * pointsys->scale + pointsys->originx, (*si)->y() * pointsys->scale + pointsys->originy, radius + 3, radius + 3);
-				agg::conv_stroke<agg::ellipse> s(circ);
-				rasterizer.add_path(s);
-				si++;
+				int x = span->x + i;
+				if (x >= 0 && x < width)
+					covers[y * width + x] = span->covers[i];
 			}
-			render_scanlines_aa_solid(rbase, rgba_selectpoint);
+			if (--num_spans == 0)
+				break;
+			++span;
+		}
+	}
+}
 
-			// hover
-			if (hilite_point)
-			{
-				rasterizer.reset();
-				agg::ellipse circ(hilite_point->x() * pointsys->scale + pointsys->originx, hilite_point->y() * pointsys->scale + pointsys->originy, radius + 3, radius + 3);
-				agg::conv_stroke<agg::ellipse> s(circ);
+void ASSDrawCanvas::PrepareMarkers()
+{
+	if (markers_scale == pointsys->scale)
+		return;
+	markers_scale = pointsys->scale;
+
+	double diameter = pointsys->scale;
+	double radius = diameter / 2.0;
+	for (int m = 0; m < MARKER_COUNT; m++)
+	{
+		// room for the rings (radius + 3, up to 2 wide) and the anti-aliasing
+		int r = (int) ceil(radius) + 5;
+		int size = r * 2;
+		markers[m].radius = r;
+		markers[m].size = size;
+		markers[m].covers.assign(size * size, 0);
+		markers[m].x0.assign(size, size);
+		markers[m].x1.assign(size, 0);
+
+		// same shapes as they used to be rasterized at every point
+		agg::rasterizer_scanline_aa<> ras;
+		if (m == MARKER_MAIN)
+		{
+			agg::path_storage sqp = agghelper::RectanglePath(r - radius, r - radius + diameter, r - radius, r - radius + diameter);
+			agg::conv_contour<agg::path_storage> c(sqp);
+			ras.add_path(c);
+		}
+		else if (m == MARKER_CONTROL)
+		{
+			agg::ellipse circ(r, r, radius, radius);
+			agg::conv_contour<agg::ellipse> c(circ);
+			ras.add_path(c);
+		}
+		else
+		{
+			agg::ellipse circ(r, r, radius + 3, radius + 3);
+			agg::conv_stroke<agg::ellipse> s(circ);
+			if (m == MARKER_HOVER)
 				s.width(2);
-				rasterizer.add_path(s);
-				render_scanlines_aa_solid(rbase, rgba_selectpoint);
-
-				rasterizer.reset();
-				agg::gsv_text t;
-				t.flip(true);
-				t.size(8.0);
-				wxPoint pxy = hilite_point->ToWxPoint(true);
-				t.start_point(pxy.x + 5, pxy.y -5);
-				t.text(wxString::Format(_T("%d,%d"), hilite_point->x(), hilite_point->y()).mb_str(wxConvUTF8));
-				agg::conv_stroke<agg::gsv_text> pt(t);
-				pt.line_cap(agg::round_cap);
-				pt.line_join(agg::round_join);
-				pt.width(1.5);
-				rasterizer.add_path(pt);
-				rsolid.color(agg::rgba(0,0,0));
-				render_scanlines(rsolid, false);
-
-				rasterizer.reset();
-				agg::path_storage sb_path;
-				sb_path.move_to(pxy.x, 0);
-				sb_path.line_to(pxy.x, hh);
-				sb_path.move_to(0, pxy.y);
-				sb_path.line_to(ww, pxy.y);
-				ConvCurve curve(sb_path);
-				ConvDashCurve d(curve);
-				d.add_dash(10,5);
-				ConvStrokeDashCurve stroke(d);
-				stroke.width(1);
-				rsolid.color(agg::rgba(0,0,0,0.5));
-				rasterizer.add_path(stroke);
-				render_scanlines(rsolid);
-			}
+			ras.add_path(s);
+		}
 
-			// selection box
-			if (lastDrag_left)
+		SweepCovers(ras, &markers[m].covers[0], size, size);
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
 			{
-				double x1 = lastDrag_left->x, y1 = lastDrag_left->y;
-				double x2 = dragAnchor_left->x, y2 = dragAnchor_left->y;
-				double lx, rx, ty, by;
-				if (x1 < x2) lx = x1, rx = x2;
-				else lx = x2, rx = x1;
-				if (y1 < y2) ty = y1, by = y2;
-				else ty = y2, by = y1;
-				rasterizer.reset();
-				agg::path_storage sb_path = agghelper::RectanglePath(lx, rx, ty, by);
-				ConvCurve curve(sb_path);
-				ConvDashCurve d(curve);
-				d.add_dash(10,5);
-				ConvStrokeDashCurve stroke(d);
-				stroke.width(1.0);
-				rsolid.color(agg::rgba(0,0,0,0.5));
-				rasterizer.add_path(stroke);
-				render_scanlines(rsolid);
+				if (markers[m].covers[y * size + x] == 0)
+					continue;
+				markers[m].x0[y] = std::min(markers[m].x0[y], x);
+				markers[m].x1[y] = x + 1;
 			}
 		}
 	}
+}
 
-	// ruler
-	int w, h;
-	GetClientSize(&w, &h);
-	double scale = pointsys->scale;
-	double coeff = 9 / scale + 1;
-	int numdist = (int) floor(coeff) * 5;
+void ASSDrawCanvas::StampMarker(RendererBase& rbase, MARKER marker, Point* point, const PixelFormat::AGGType::color_type& color)
+{
+	// snapped to the nearest pixel corner
+	int x = agg::iround(point->x() * pointsys->scale + pointsys->originx) - markers[marker].radius;
+	int y = agg::iround(point->y() * pointsys->scale + pointsys->originy) - markers[marker].radius;
+	int size = markers[marker].size;
+	if (x > rbase.xmax() || y > rbase.ymax() || x + size <= rbase.xmin() || y + size <= rbase.ymin())
+		return;
+
+	int min_x = size, min_y = size, max_x = -1, max_y = -1;
+	const agg::int8u *covers = &markers[marker].covers[0];
+	for (int row = 0; row < size; row++, covers += size)
+	{
+		int x0 = markers[marker].x0[row], x1 = markers[marker].x1[row];
+		if (x0 >= x1)
+			continue;
+		rbase.blend_solid_hspan(x + x0, y + row, x1 - x0, color, covers + x0);
+		min_x = std::min(min_x, x0), max_x = std::max(max_x, x1 - 1);
+		min_y = std::min(min_y, row), max_y = row;
+	}
+	// the markers count towards the rendered bounds like everything else drawn
+	if (max_y >= 0)
+		UpdateRenderedBoundCoords(x + min_x, y + min_y, x + max_x, y + max_y);
+}
+
+void ASSDrawCanvas::DrawOverlays(RendererBase& rbase, RendererSolid& rsolid, agg::trans_affine& mtx)
+{
+	int ww, hh; GetClientSize(&ww, &hh);
+
+	if (IsTransformMode() && isshapetransformable)
 	{
-		rsolid.color(rgba_ruler_h);
+		if (draw_mode == MODE_SCALEROTATE)
+		{
+			// rotation centerpoint
+			rasterizer.reset();
+			double len = 10.0;
+			agg::path_storage org_path;
+			org_path.move_to(rectcenter.x - len, rectcenter.y - len);
+			org_path.line_to(rectcenter.x + len, rectcenter.y + len);
+			org_path.move_to(rectcenter.x + len, rectcenter.y - len);
+			org_path.line_to(rectcenter.x - len, rectcenter.y + len);
+			agg::conv_stroke<agg::path_storage> cstroke(org_path);
+			rasterizer.add_path(cstroke);
+			agg::ellipse circ(rectcenter.x, rectcenter.y, len, len);
+			agg::conv_stroke<agg::ellipse> c(circ);
+			rasterizer.add_path(c);
+			rsolid.color(rgba_origin);
+			render_scanlines(rsolid, false);
+		}
+
 		rasterizer.reset();
-		agg::path_storage rlr_path;
-		double start = pointsys->originx;
-		int t = - (int) floor(start / scale);
-		double s = (start + t * scale);
-		double collect = s;
-		int len;
-
-		for (; s <= w; s += scale)
+		agg::path_storage org_path;
+		org_path.move_to(rectbound2[0].x, rectbound2[0].y);
+		org_path.line_to(rectbound2[1].x, rectbound2[1].y);
+		org_path.line_to(rectbound2[2].x, rectbound2[2].y);
+		org_path.line_to(rectbound2[3].x, rectbound2[3].y);
+		org_path.line_to(rectbound2[0].x, rectbound2[0].y);
+		agg::conv_stroke<agg::path_storage> chstroke(org_path);
+		chstroke.width(1);
+		rsolid.color(rgba_origin);
+		rasterizer.add_path(chstroke);
+		if (rectbound2upd != -1)
 		{
-			bool longtick = t % numdist == 0;
-			if (longtick)
-			{
-				len = 10;
-				agg::gsv_text txt;
-				txt.flip(true);
-				txt.size(6.0);
-				txt.start_point(s, 20);
-				txt.text(wxString::Format(_T("%d"), t).mb_str(wxConvUTF8));
-				agg::conv_stroke<agg::gsv_text> pt(txt);
-				rasterizer.add_path(pt);
-			}
-			else
-				len = 5;
-			t++ ;
-			collect += scale;
-			if (collect > 5.0)
-			{
-				collect = 0.0;
-				rlr_path.move_to(s, 0);
-				rlr_path.line_to(s, len);
-			}
+			agg::ellipse circ(rectbound2[rectbound2upd].x, rectbound2[rectbound2upd].y, pointsys->scale, pointsys->scale);
+			agg::conv_contour< agg::ellipse > c(circ);
+			rasterizer.add_path(c);
+		}
+		if (rectbound2upd2 != -1)
+		{
+			agg::ellipse circ(rectbound2[rectbound2upd2].x, rectbound2[rectbound2upd2].y, pointsys->scale, pointsys->scale);
+			agg::conv_contour< agg::ellipse > c(circ);
+			rasterizer.add_path(c);
 		}
-		agg::conv_stroke<agg::path_storage> rlr_stroke(rlr_path);
-		rlr_stroke.width(1);
-		rasterizer.add_path(rlr_stroke);
 		render_scanlines(rsolid, false);
+		return;
 	}
+
+	// hilite
+	if (hilite_cmd && hilite_cmd->type != M)
+	{
+		rasterizer.reset();
+		agg::path_storage h_path;
+		AddDrawCmdToAGGPathStorage(hilite_cmd, h_path, HILITE);
+		ConvTransAffine h_path_trans(h_path, mtx);
+		ConvCurveTransAffine curve(h_path_trans);
+		if (curve_quality > 0)
+			curve.approximation_scale(curve_quality / 2.0);
+		ConvDashCurveTransAffine d(curve);
+		d.add_dash(10,5);
+		agg::conv_stroke<ConvDashCurveTransAffine> stroke(d);
+		stroke.width(3);
+		rsolid.color(rgba_outline);
+		rasterizer.add_path(stroke);
+		render_scanlines(rsolid);
+	}
+
+	// selection
+	PrepareMarkers();
+	PixelFormat::AGGType::color_type selectcolor(rgba_selectpoint);
+	PointSet::iterator si = selected_points.begin();
+	while (si != selected_points.end())
+	{
+		StampMarker(rbase, MARKER_SELECTED, *si, selectcolor);
+		si++;
+	}
+
+	// hover
+	if (hilite_point)
+	{
+		StampMarker(rbase, MARKER_HOVER, hilite_point, selectcolor);
+
+		rasterizer.reset();
+		agg::gsv_text t;
+		t.flip(true);
+		t.size(8.0);
+		wxPoint pxy = hilite_point->ToWxPoint(true);
+		t.start_point(pxy.x + 5, pxy.y -5);
+		t.text(wxString::Format(_T("%d,%d"), hilite_point->x(), hilite_point->y()).mb_str(wxConvUTF8));
+		agg::conv_stroke<agg::gsv_text> pt(t);
+		pt.line_cap(agg::round_cap);
+		pt.line_join(agg::round_join);
+		pt.width(1.5);
+		rasterizer.add_path(pt);
+		rsolid.color(agg::rgba(0,0,0));
+		render_scanlines(rsolid, false);
+
+		rasterizer.reset();
+		agg::path_storage sb_path;
+		sb_path.move_to(pxy.x, 0);
+		sb_path.line_to(pxy.x, hh);
+		sb_path.move_to(0, pxy.y);
+		sb_path.line_to(ww, pxy.y);
+		ConvCurve curve(sb_path);
+		ConvDashCurve d(curve);
+		d.add_dash(10,5);
+		ConvStrokeDashCurve stroke(d);
+		stroke.width(1);
+		rsolid.color(agg::rgba(0,0,0,0.5));
+		rasterizer.add_path(stroke);
+		render_scanlines(rsolid);
+	}
+
+	// selection box
+	if (lastDrag_left)
 	{
+		double x1 = lastDrag_left->x, y1 = lastDrag_left->y;
+		double x2 = dragAnchor_left->x, y2 = dragAnchor_left->y;
+		double lx, rx, ty, by;
+		if (x1 < x2) lx = x1, rx = x2;
+		else lx = x2, rx = x1;
+		if (y1 < y2) ty = y1, by = y2;
+		else ty = y2, by = y1;
 		rasterizer.reset();
-		rsolid.color(rgba_ruler_v);
-		agg::path_storage rlr_path;
-		double start = pointsys->originy;
-		int t = - (int) floor(start / scale);
-		double s = (start + t * scale);
-		double collect = 0;
-		int len;
-
-		for (; s <= h; s += scale)
+		agg::path_storage sb_path = agghelper::RectanglePath(lx, rx, ty, by);
+		ConvCurve curve(sb_path);
+		ConvDashCurve d(curve);
+		d.add_dash(10,5);
+		ConvStrokeDashCurve stroke(d);
+		stroke.width(1.0);
+		rsolid.color(agg::rgba(0,0,0,0.5));
+		rasterizer.add_path(stroke);
+		render_scanlines(rsolid);
+	}
+}
+
+void ASSDrawCanvas::UpdateRulers(int w, int h)
+{
+	for (int r = 0; r < RULER_COUNT; r++)
+	{
+		int length = r == RULER_H? w:h;
+		double origin = r == RULER_H? pointsys->originx:pointsys->originy;
+		int width = r == RULER_H? length:RULER_V_THICKNESS;
+		int height = r == RULER_H? RULER_H_THICKNESS:length;
+		double moved = origin - rulers[r].origin;
+		int shift = (int) floor(moved + 0.5);
+
+		if (length != rulers[r].length || pointsys->scale != rulers[r].scale
+			|| fabs(moved - shift) > 1e-6 || abs(shift) >= length || (!draft && !rulers[r].labelled))
 		{
-			bool longtick = t % numdist == 0;
-			if (longtick)
+			rulers[r].covers.assign(width * height, 0);
+			rulers[r].width = width;
+			rulers[r].height = height;
+			rulers[r].length = length;
+			rulers[r].scale = pointsys->scale;
+			rulers[r].origin = origin;
+			rulers[r].labelled = true;
+			RenderRulerSegment((RULER) r, 0, length);
+			continue;
+		}
+		if (shift == 0)
+			continue;
+
+		// scroll what's there and fill in the pixels that scrolled in
+		rulers[r].origin = origin;
+		agg::int8u* covers = &rulers[r].covers[0];
+		if (r == RULER_H)
+		{
+			for (int y = 0; y < height; y++, covers += width)
 			{
-				len = 10;
-				agg::gsv_text txt;
-				txt.flip(true);
-				txt.size(6.0);
+				if (shift > 0)
+					memmove(covers + shift, covers, width - shift);
+				else
+					memmove(covers, covers - shift, width + shift);
+			}
+		}
+		else if (shift > 0)
+			memmove(covers + shift * width, covers, (height - shift) * width);
+		else
+			memmove(covers, covers - shift * width, (height + shift) * width);
+		if (shift > 0)
+			RenderRulerSegment((RULER) r, 0, shift);
+		else
+			RenderRulerSegment((RULER) r, length + shift, length);
+	}
+}
+
+void ASSDrawCanvas::RenderRulerSegment(RULER ruler, int from, int to)
+{
+	if (from >= to)
+		return;
+	int width = rulers[ruler].width, height = rulers[ruler].height;
+	agg::int8u* covers = &rulers[ruler].covers[0];
+	agg::rasterizer_scanline_aa<> ras;
+	if (ruler == RULER_H)
+	{
+		for (int y = 0; y < height; y++)
+			memset(covers + y * width + from, 0, to - from);
+		ras.clip_box(from, 0, to, height);
+	}
+	else
+	{
+		memset(covers + from * width, 0, (to - from) * width);
+		ras.clip_box(0, from, width, to);
+	}
+
+	double scale = pointsys->scale;
+	double origin = rulers[ruler].origin;
+	double coeff = 9 / scale + 1;
+	int numdist = (int) floor(coeff) * 5;
+	// short ticks more than 5 pixels apart; counted from tick 0, not from the edge of
+	// the window, so they stay put when panning
+	int tickdist = (int) floor(5.0 / scale) + 1;
+	// the labels reach up (left ruler) or right (top ruler) of their tick
+	int reach = ruler == RULER_H? RULER_V_THICKNESS:10;
+	int t = (int) ceil((from - reach - origin) / scale);
+	int last = (int) floor((to + 1 - origin) / scale);
+
+	agg::path_storage rlr_path;
+	for (; t <= last; t++)
+	{
+		double s = origin + t * scale;
+		bool longtick = t % numdist == 0;
+		if (longtick && !draft)
+		{
+			agg::gsv_text txt;
+			txt.flip(true);
+			txt.size(6.0);
+			if (ruler == RULER_H)
+				txt.start_point(s, 20);
+			else
 				txt.start_point(12, s);
-				txt.text(wxString::Format(_T("%d"), t).mb_str(wxConvUTF8));
-				agg::conv_stroke<agg::gsv_text> pt(txt);
-				rasterizer.add_path(pt);
+			txt.text(wxString::Format(_T("%d"), t).mb_str(wxConvUTF8));
+			agg::conv_stroke<agg::gsv_text> pt(txt);
+			ras.add_path(pt);
+		}
+		if (longtick || t % tickdist == 0)
+		{
+			int len = longtick? 10:5;
+			if (ruler == RULER_H)
+			{
+				rlr_path.move_to(s, 0);
+				rlr_path.line_to(s, len);
 			}
 			else
-				len = 5;
-			t++ ;
-			collect += scale;
-			if (collect > 5.0)
 			{
-				collect = 0.0;
 				rlr_path.move_to(0, s);
 				rlr_path.line_to(len, s);
 			}
 		}
-		agg::conv_stroke<agg::path_storage> rlr_stroke(rlr_path);
-		rlr_stroke.width(1);
-		rasterizer.add_path(rlr_stroke);
-		render_scanlines(rsolid, false);
+	}
+	agg::conv_stroke<agg::path_storage> rlr_stroke(rlr_path);
+	rlr_stroke.width(1);
+	ras.add_path(rlr_stroke);
+	SweepCovers(ras, covers, width, height);
+	if (draft)
+		rulers[ruler].labelled = false;
+}
+
+void ASSDrawCanvas::DrawRulers(RendererBase& rbase)
+{
+	for (int r = 0; r < RULER_COUNT; r++)
+	{
+		PixelFormat::AGGType::color_type color(r == RULER_H? rgba_ruler_h:rgba_ruler_v);
+		int width = rulers[r].width;
+		const agg::int8u* covers = rulers[r].covers.empty()? NULL:&rulers[r].covers[0];
+		for (int y = 0; y < rulers[r].height; y++, covers += width)
+		{
+			if (y < rbase.ymin() || y > rbase.ymax())
+				continue;
+			// most of a ruler is empty
+			int x0 = 0, x1 = width;
+			while (x0 < x1 && covers[x0] == 0)
+				x0++;
+			while (x1 > x0 && covers[x1 - 1] == 0)
+				x1--;
+			if (x0 < x1)
+				rbase.blend_solid_hspan(x0, y, x1 - x0, color, covers + x0);
+		}
 	}
 }
 
@@ -1553,7 +2409,13 @@ void ASSDrawCanvas::RemoveBackgroundImage()
 	if (bgimg.bgbmp)
 		delete bgimg.bgbmp;
 	bgimg.bgbmp = NULL;
+	bgimg.sources.clear();
+	// layerthread lets go of it once it has drawn the job in hand
+	if (bgimg.faded)
+		bgimg.faded->Unref();
+	bgimg.faded = NULL;
 	bgimg.bgimgfile = _T("");
+	InvalidateLayer(LAYER_BACKGROUND);
 	RefreshDisplay();
 	drag_mode = DRAGMODE();
 	bgimg.alpha_dlg->Show(false);
@@ -1565,6 +2427,9 @@ void ASSDrawCanvas::SetBackgroundImage(const wxImage& img, wxString fname, bool
 	if (bgimg.bgimg)
 		delete bgimg.bgimg;
 	bgimg.bgimg = new wxImage(img);
+	if (bgimg.bgbmp)
+		delete bgimg.bgbmp;
+	bgimg.bgbmp = NULL;
 	bgimg.bgimgfile = fname;
 	double alpha = (255.0 - (double) m_frame->alphas.dfltimgopac) / 255.0;
 	PrepareBackgroundBitmap(alpha);
@@ -1588,31 +2453,62 @@ void ASSDrawCanvas::PrepareBackgroundBitmap(double alpha)
 		bgimg.alpha = alpha;
 	if (bgimg.bgimg == NULL)
 		return;
-	if (bgimg.bgbmp)
-		delete bgimg.bgbmp;
-	bgimg.bgbmp = new wxBitmap(*bgimg.bgimg);
-	PixelData data(*bgimg.bgbmp);
-	wxAlphaPixelFormat::ChannelType* pd = (wxAlphaPixelFormat::ChannelType*) &data.GetPixels().Data();
-	const int stride = data.GetRowStride();
-	if (stride < 0)
-		pd += (data.GetHeight() - 1) * stride;
-	bgimg.ibuf.attach(pd, data.GetWidth(), data.GetHeight(), stride);
-
-	// apply alpha
-	rasterizer.reset();
-	unsigned w = bgimg.bgbmp->GetWidth(), h = bgimg.bgbmp->GetHeight();
-	bgimg.bg_path = agghelper::RectanglePath(0, w, 0, h);
-	agg::conv_contour< agg::path_storage > cont(bgimg.bg_path);
-	rasterizer.add_path(cont);
-	PixelFormat::AGGType pxt(bgimg.ibuf);
-	RendererBase rpxt(pxt);
-	agg::render_scanlines_aa_solid(rasterizer, scanline, rpxt, agg::rgba(color_bg.r / 255.0, color_bg.g / 255.0, color_bg.b / 255.0, bgimg.alpha));
+	// the background is under everything
+	InvalidateLayer(LAYER_BACKGROUND);
+	const unsigned pw = PixelFormat::AGGType::pix_width;
+	if (bgimg.bgbmp == NULL)
+	{
+		// the bitmap is made once per image, and its pixels kept to fade from
+		bgimg.bgbmp = new wxBitmap(*bgimg.bgimg);
+		PixelData data(*bgimg.bgbmp);
+		wxAlphaPixelFormat::ChannelType* pd = (wxAlphaPixelFormat::ChannelType*) &data.GetPixels().Data();
+		const int stride = data.GetRowStride();
+		if (stride < 0)
+			pd += (data.GetHeight() - 1) * stride;
+		agg::rendering_buffer ibuf(pd, data.GetWidth(), data.GetHeight(), stride);
+		unsigned w = ibuf.width(), h = ibuf.height();
+		// with the mip levels, down to a pixel high or wide
+		size_t levels = 1;
+		for (unsigned mw = w, mh = h; mw >= 2 && mh >= 2; mw /= 2, mh /= 2)
+			levels++;
+		bgimg.sources.clear();
+		bgimg.sources.resize(levels);
+		bgimg.sources[0].resize(w * h * pw);
+		for (unsigned y = 0; y < h; y++)
+			memcpy(&bgimg.sources[0][y * w * pw], ibuf.row_ptr(y), w * pw);
+		for (size_t l = 1; l < levels; l++, w /= 2, h /= 2)
+		{
+			bgimg.sources[l].resize((w / 2) * (h / 2) * pw);
+			HalvePixels(&bgimg.sources[l - 1][0], w, h, pw, &bgimg.sources[l][0]);
+		}
+	}
+
+	// apply alpha: lay the canvas colour over the kept pixels, of every level; into new
+	// pixels, as layerthread may still be drawing a job from the ones there are
+	if (bgimg.faded)
+		bgimg.faded->Unref();
+	bgimg.faded = NULL;
+	if (bgimg.sources[0].empty())
+		return;
+	FadedBackground* faded = new FadedBackground(bgimg.sources.size());
+	color_type c(color_bg.r, color_bg.g, color_bg.b, agg::uround(bgimg.alpha * 255.0));
+	for (size_t l = 0; l < bgimg.sources.size(); l++)
+	{
+		const unsigned w = bgimg.bgbmp->GetWidth() >> l, h = bgimg.bgbmp->GetHeight() >> l;
+		faded->pixels[l].resize(bgimg.sources[l].size());
+		faded->level[l].attach(&faded->pixels[l][0], w, h, w * pw);
+		PixelFormat::AGGType pxt(faded->level[l]);
+		for (unsigned y = 0; y < h; y++)
+			pxt.blend_hline_from(0, y, w, &bgimg.sources[l][y * w * pw], c);
+	}
+	bgimg.faded = faded;
 }
 
 void ASSDrawCanvas::UpdateBackgroundImgScalePosition(bool firsttime)
 {
 	if (bgimg.bgbmp == NULL)
 		return;
+	// CollectDamage redraws (or scrolls) the background layer when it sees path_mtx changed
 	// transform the enclosing polygon
 	unsigned w = bgimg.bgbmp->GetWidth(), h = bgimg.bgbmp->GetHeight();
 	bgimg.bg_path = agghelper::RectanglePath(0, w, 0, h);
@@ -1686,38 +2582,7 @@ void ASSDrawCanvas::UpdateNonUniformTransformation()
 		rectbound2[1].x, rectbound2[1].y,
 		rectbound2[2].x, rectbound2[2].y,
 		rectbound2[3].x, rectbound2[3].y };
-	agg::path_storage trans;
-	unsigned vertices = backupcmds.total_vertices();
-
-	agg::trans_bilinear trans_b(rectbound[0].x, rectbound[0].y, rectbound[2].x, rectbound[2].y, bound);
-	agg::conv_transform<agg::path_storage, agg::trans_bilinear> transb(backupcmds, trans_b);
-	transb.rewind(0);
-	for (unsigned i = 0; i < vertices; i++)
-	{
-		double x, y;
-		transb.vertex(&x, &y);
-		trans.move_to(x, y);
-	}
-
-	trans.rewind(0);
-	for (DrawCmdList::iterator iterate = cmds.begin(); iterate != cmds.end(); iterate++)
-	{
-		DrawCmd* cmd = (*iterate);
-		for (PointList::iterator iterate2 = cmd->controlpoints.begin(); iterate2 != cmd->controlpoints.end(); iterate2++)
-		{
-			double x, y;
-			trans.vertex(&x, &y);
-			int wx, wy;
-			pointsys->FromWxPoint(wxPoint((int)x, (int)y), wx, wy);
-			(*iterate2)->setXY(wx, wy);
-		}
-		double x, y;
-		trans.vertex(&x, &y);
-		int wx, wy;
-		pointsys->FromWxPoint(wxPoint((int)x, (int)y), wx, wy);
-		(*iterate)->m_point->setXY(wx, wy);
-	}
-
+	TransformPointsBilinear(backupcmds, rectbound[0].x, rectbound[0].y, rectbound[2].x, rectbound[2].y, bound);
 }
 
 void ASSDrawCanvas::CustomOnKeyDown(wxKeyEvent &event)
@@ -1826,6 +2691,25 @@ void ASSDrawCanvas::CustomOnKeyDown(wxKeyEvent &event)
 				}
 			}
 			break;
+		case WXK_DELETE:
+			// delete the commands of all selected main points
+			if (mousedownAt_point == NULL && !IsTransformMode() && !selected_points.empty())
+			{
+				DrawCmdSet todelete;
+				for (PointSet::iterator it = selected_points.begin(); it != selected_points.end(); it++)
+					if ((*it)->type == MP)
+						todelete.insert((*it)->cmd_main);
+				ClearPointsSelection();
+				SetHighlighted(NULL, NULL);
+				pointedAt_point = NULL;
+				if (DeleteCommands(todelete) > 0)
+				{
+					AddUndo(_T("Delete selected points"));
+					RefreshUndocmds();
+				}
+				RefreshDisplay();
+			}
+			break;
 		default:
 			event.Skip();
 		}
@@ -1858,11 +2742,11 @@ void ASSDrawCanvas::CustomOnMouseCaptureLost(wxMouseCaptureLostEvent &)
 		ProcessOnMouseRightUp();
 }
 
-void UndoRedo::Import(ASSDrawCanvas *canvas, bool prestage, wxString cmds)
+void UndoRedo::Import(ASSDrawCanvas *canvas, bool prestage)
 {
 	if (prestage)
 	{
-		this->cmds = cmds;
+		canvas->GenerateBinary(this->cmds);
 		this->backupcmds.free_all();
 		this->backupcmds.concat_path(canvas->backupcmds);
 		for (int i = 0; i < 4; i++)
@@ -1884,7 +2768,6 @@ void UndoRedo::Import(ASSDrawCanvas *canvas, bool prestage, wxString cmds)
 		this->bgcenter = canvas->bgimg.center;
 		this->bgscale = canvas->bgimg.scale;
 		this->bgalpha = canvas->bgimg.alpha;
-		this->c1cont = canvas->PrepareC1ContData();
 		this->draw_mode = canvas->draw_mode;
 	}
 }
@@ -1894,12 +2777,8 @@ void UndoRedo::Export(ASSDrawCanvas *canvas)
 	canvas->pointsys->originx = this->originx;
 	canvas->pointsys->originy = this->originy;
 	canvas->pointsys->scale = this->scale;
-	canvas->ParseASS(this->cmds);
-	DrawCmdList::iterator it1 = canvas->cmds.begin();
-	std::vector< bool >::iterator it2 = this->c1cont.begin();
-	for(; it1 != canvas->cmds.end() && it2 != this->c1cont.end(); it1++, it2++)
-		if (*it2 && (*it1)->type == B)
-			static_cast<DrawCmd_B*>(*it1)->C1Cont = true;
+	// C1Cont is part of the binary encoding
+	canvas->ParseBinary(this->cmds);
 
 	if (canvas->bgimg.bgimgfile != this->bgimgfile)
 	{
@@ -45,20 +45,25 @@
 #include <wx/clntdata.h>
 
 #include <agg_span_allocator.h>
+#include <agg_image_accessors.h>
 #include <agg_span_interpolator_linear.h>
 #include <agg_span_image_filter_rgb.h>
 #include <agg_span_image_filter_rgba.h>
+#include <agg_scanline_u.h>
 
 class ASSDrawFrame;
 class ASSDrawCanvas;
+class ShapeLayerThread;
+struct ShapeLayerJob;
+class FadedBackground;
 
 struct UndoRedo
 {
-	wxString cmds;
+	// the drawing, encoded with ASSDrawShape::GenerateBinary
+	std::string cmds;
 	wxString desc;
 	double originx, originy, scale;
 
-	std::vector< bool > c1cont;
 	wxString bgimgfile;
 	wxRealPoint bgdisp, bgcenter;
 	double bgscale, bgalpha;
@@ -68,13 +73,11 @@ struct UndoRedo
 	wxRealPoint rectbound[4], rectbound2[4], backup[4];
 	bool isshapetransformable;
 
-	void Import(ASSDrawCanvas *canvas, bool prestage, wxString cmds = _T(""));
+	void Import(ASSDrawCanvas *canvas, bool prestage);
 	void Export(ASSDrawCanvas *canvas);
 };
 
 // for multiple point selection
-enum SELECTMODE { NEW, ADD, DEL };
-
 class ASSDrawCanvas: public ASSDrawEngine, public wxClientData
 {
 public:
@@ -86,14 +89,13 @@ public:
 	virtual void ResetEngine(bool addM);
 	virtual void SetPreviewMode(bool mode);
 	virtual bool IsPreviewMode() { return preview_mode; }
-	virtual void ParseASS(wxString str, bool addundo = false);
+	virtual void ParseASS(const wxString& str, bool addundo = false);
 
 	virtual void SetDrawMode(MODE mode);
 	virtual MODE GetDrawMode() { return draw_mode; }
 	virtual bool IsTransformMode() { return draw_mode == MODE_NUT_BILINEAR || draw_mode == MODE_SCALEROTATE; }
 	virtual void SetDragMode(DRAGMODE mode) { drag_mode = mode; }
 	virtual DRAGMODE GetDragMode() { return drag_mode; }
-	virtual void RefreshDisplay();
 	virtual bool CanZoom() { return !IsTransformMode() || !drag_mode.drawing; }
 	virtual bool CanMove() { return !IsTransformMode() || dragAnchor_left == NULL; }
 
@@ -132,7 +134,7 @@ public:
 	virtual bool Redo() { return UndoOrRedo(false); }
 	virtual wxString GetTopUndo();
 	virtual wxString GetTopRedo();
-	virtual void RefreshUndocmds() { _undo.Import(this, true, GenerateASS()); }
+	virtual void RefreshUndocmds() { _undo.Import(this, true); }
 
 	virtual bool HasBackgroundImage() { return bgimg.bgimg != NULL; }
 	virtual void RemoveBackgroundImage();
@@ -146,11 +148,19 @@ public:
 	agg::rgba rgba_mainpoint, rgba_controlpoint, rgba_selectpoint;
 	agg::rgba rgba_origin, rgba_ruler_h, rgba_ruler_v;
 
+	// draft rendering while the mouse drags something: whether to, the curve quality of the
+	// drafts, and how many milliseconds the mouse has to rest for it to be drawn properly
+	// (0 waits for the button to be released)
+	bool draft_drag;
+	int draft_curve_quality, draft_idle;
+
 protected:
 
 	typedef PixelFormat::AGGType::color_type color_type;
 	typedef agg::span_interpolator_linear<> interpolator_type;
 	typedef agg::span_image_filter_rgb_bilinear_clip<PixelFormat::AGGType, interpolator_type> span_gen_type;
+	typedef agg::image_accessor_clip<PixelFormat::AGGType> img_accessor_type;
+	typedef agg::span_image_filter_rgb_nn<img_accessor_type, interpolator_type> span_gen_draft_type;
 
 	// The GUI window
 	ASSDrawFrame* m_frame;
@@ -206,9 +216,13 @@ protected:
 	// background image!
 	struct
 	{
-		agg::rendering_buffer ibuf;
 		wxImage *bgimg;
 		wxBitmap *bgbmp;
+		// the pixels of bgbmp before they were faded towards the canvas colour, then box
+		// filtered to half the size, half that and so on, to draw from when zoomed out
+		std::vector< std::vector<agg::int8u> > sources;
+		// and after, as they're drawn (NULL if there's nothing to draw)
+		FadedBackground *faded;
 		wxString bgimgfile;
 		agg::path_storage bg_path;
 		agg::span_allocator<color_type> spanalloc;
@@ -221,7 +235,7 @@ protected:
 		wxSlider* alpha_slider;
 	} bgimg;
 
-	// Undo/redo system (simply stores the ASS commands)
+	// Undo/redo system (simply stores the drawing commands)
 	std::list<UndoRedo> undos;
 	std::list<UndoRedo> redos;
 	UndoRedo _undo;
@@ -230,6 +244,7 @@ protected:
 	wxString undodesc;
 
 	wxString oldasscmds;
+	unsigned long oldassrevision;
 
 	// was preview_mode
 	//bool was_preview_mode;
@@ -237,7 +252,7 @@ protected:
 	PointSystem* _PointSystem() { return pointsys; }
 
 	// for Undo/Redo system
-	virtual void PrepareUndoRedo(UndoRedo& ur, bool prestage, wxString cmds, wxString desc);
+	virtual void PrepareUndoRedo(UndoRedo& ur, bool prestage, wxString desc);
 
 	// -------------------- points highlight/selection ---------------------------
 
@@ -261,8 +276,150 @@ protected:
 	wxRealPoint rectbound[4], rectbound2[4], backup[4], rectcenter;
 	bool isshapetransformable;
 
+	// -------------------- dirty rectangles ---------------------------
+
+	// what a command looked like the last time the display was refreshed
+	struct CmdFootprint
+	{
+		// hash of everything about the command that shows on the canvas, 0 for unused handles
+		unsigned long hash;
+		// bounding box of the command in drawing coordinates
+		double x1, y1, x2, y2;
+		CmdFootprint() : hash(0), x1(0), y1(0), x2(0), y2(0) { }
+	};
+	std::vector<CmdFootprint> footprints, newfootprints; // indexed by DrawCmd::Handle()
+	std::vector<wxRect> overlays, newoverlays;
+	unsigned long scenehash;
+	// where the view and the background image were; moving both by whole pixels scrolls
+	// what's already drawn instead of drawing it all again
+	double scene_originx, scene_originy;
+	wxBitmap *scene_bgbmp;
+	agg::trans_affine scene_bgmtx;
+
+	// update the ASS commands in the frame's text box if the drawing changed
+	virtual void PrepareFrame();
+	// invalidate the commands and overlays that changed since the last refresh,
+	// or everything if the view itself changed
+	virtual void CollectDamage();
+	virtual void CollectCmdFootprints(std::vector<CmdFootprint>& fps);
+	// screen rectangles covering the highlight, selection, hover and selection box
+	virtual void CollectOverlayRects(std::vector<wxRect>& rects, std::vector<CmdFootprint>& fps);
+	// hash of everything else that changes the whole canvas (zoom, size, colors, modes)
+	virtual unsigned long SceneHash();
+	// scroll the layers and the window by dx, dy pixels, along with what's out of date in them
+	virtual void ScrollLayers(int dx, int dy);
+	wxRect DrawingToWxRect(double x1, double y1, double x2, double y2, int pad);
+
+	// -------------------- cached layers ---------------------------
+
+	// what doesn't change with every mouse move is drawn into offscreen layers, each one on
+	// top of a copy of the one below; the window gets a copy of the top layer with the
+	// overlays (highlight, selection, hover, transform box) and the rulers drawn over it.
+	// The background layer and the shape layer (the fill and the outlines) are drawn by
+	// layerthread if there is one, which keeps the background layer to itself; the origin
+	// and the points go on a layer of their own so they never wait for it
+	enum LAYER { LAYER_BACKGROUND, LAYER_SHAPE, LAYER_POINTS, LAYER_COUNT };
+	struct
+	{
+		std::vector<agg::int8u> pixels;
+		agg::rendering_buffer rbuf;
+		int width, height;
+		std::vector<wxRect> dirty;
+		// some of it is a draft
+		bool draft;
+	} layers[LAYER_COUNT];
+	// draws the shape layer from snapshots of the drawing, one at a time (see
+	// layerthread.hpp); while it's busy the shape layer keeps showing the last snapshot
+	// and collects what to redraw next
+	ShapeLayerThread *layerthread;
+	bool layerjob_busy;
+	// how far the layers have scrolled since the snapshot being drawn was taken, and the
+	// background layer since the last one was
+	int layerjob_dx, layerjob_dy;
+	int background_dx, background_dy;
+	// the drawing as of store revision snapshot_revision, encoded with GenerateBinary
+	std::string snapshot;
+	unsigned long snapshot_revision;
+	// the pixels of the shape layer before the last drawn snapshot replaced them, for the next
+	// snapshot to be drawn over; spare_stale is where they differ from the layer, and only
+	// that is copied over before they're handed to layerthread again
+	std::vector<agg::int8u> layer_spare;
+	std::vector<wxRect> spare_stale;
+	// hand the out of date parts of the background and shape layers to layerthread, unless
+	// it's busy
+	virtual void SubmitShapeLayer();
+	friend class ShapeLayerThread;
+	// the snapshot has been drawn: show it
+	void OnShapeLayerDone(wxCommandEvent& event);
+
+	// the rulers are kept as coverage strips along the top and the left edge, anchored to the
+	// drawing rather than the window; panning by whole pixels shifts them and only rasterizes
+	// the part that comes into view, anything else (zoom, resize) rasterizes them again
+	enum RULER { RULER_H, RULER_V, RULER_COUNT };
+	struct
+	{
+		// width x height covers, the ruler runs along the first length pixels of them
+		std::vector<agg::int8u> covers;
+		int width, height, length;
+		// what they were rasterized for; origin is pointsys->originx or originy
+		double scale, origin;
+		// false if some of it was rasterized without the labels, for a draft
+		bool labelled;
+	} rulers[RULER_COUNT];
+
+	// the point markers are rasterized once per zoom into coverage masks, which are then
+	// blended in the marker's colour at every point that's inside the part being drawn
+	enum MARKER { MARKER_MAIN, MARKER_CONTROL, MARKER_SELECTED, MARKER_HOVER, MARKER_COUNT };
+	struct
+	{
+		// the point is at the corner between pixels radius - 1 and radius of the size x size
+		// covers; row y has coverage from x0[y] to x1[y] (exclusive) only
+		int radius, size;
+		std::vector<agg::int8u> covers;
+		std::vector<int> x0, x1;
+	} markers[MARKER_COUNT];
+	double markers_scale;
+	virtual void PrepareMarkers();
+	void StampMarker(RendererBase& rbase, MARKER marker, Point* point, const PixelFormat::AGGType::color_type& color);
+
+	// -------------------- draft rendering ---------------------------
+
+	// while the mouse drags something, the shape layer is drawn at half the resolution and
+	// with coarser curves, the background image without filtering and the rulers without
+	// labels; whatever was drawn that way is drawn properly again once the button is
+	// released or the mouse rests for draft_idle milliseconds
+	bool draft;
+	wxTimer draft_timer;
+	// the mouse has moved with a button held
+	virtual void BeginDraft();
+	// draw the drafts properly
+	virtual void EndDraft();
+	void OnDraftTimer(wxTimerEvent& event);
+
+	// redraw rect of a layer (and of those above it and the window) with the next refresh
+	virtual void InvalidateLayer(LAYER layer, const wxRect& rect);
+	virtual void InvalidateLayer(LAYER layer);
+	// redraw the out of date parts of the layers
+	virtual void UpdateLayers(RendererBase& rbase, agg::trans_affine& mtx);
+
 	// do the real drawing
 	virtual void DoDraw(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx);
+	virtual void DrawBackgroundLayer(RendererBase& rbase);
+	// the level of bgimg.faded to draw the background image from at its scale, and in
+	// img_mtx what takes the layer's pixels to it
+	size_t BackgroundLevel(agg::trans_affine& img_mtx);
+	// draw the background image from ibuf inside path (put on the layer by path_mtx) with ras
+	// and sl, the nearest pixel for a draft and bilinear otherwise; layerthread uses it too
+	static void RenderBackgroundImage(RendererBase& rbase, agg::rasterizer_scanline_aa<>& ras, agg::scanline_p8& sl, agg::span_allocator<color_type>& spanalloc,
+		agg::rendering_buffer& ibuf, const agg::trans_affine& img_mtx, agg::path_storage& path, const agg::trans_affine& path_mtx, bool draft);
+	virtual void DrawShapeLayer(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx);
+	virtual void DrawPointsLayer(RendererBase& rbase, RendererSolid& rsolid, agg::trans_affine& mtx);
+	virtual void DrawOverlays(RendererBase& rbase, RendererSolid& rsolid, agg::trans_affine& mtx);
+	// bring the ruler strips up to date with the zoom, pan and size of the window
+	virtual void UpdateRulers(int w, int h);
+	// rasterize pixels from to to (exclusive) along the ruler, leaving the rest of it alone
+	virtual void RenderRulerSegment(RULER ruler, int from, int to);
+	virtual void DrawRulers(RendererBase& rbase);
 
 	// update background image scale & position
 	virtual void UpdateBackgroundImgScalePosition(bool firsttime = false);
@@ -97,6 +97,11 @@ enum {
 	 TB_BGALPHA_SLIDER = 117
 };
 
+// enum for IDs of timers
+enum {
+	TIMER_DRAFT = 130
+};
+
 enum DRAGMODETOOL
 {
 	DRAG_DWG = 120,
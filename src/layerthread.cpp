@@ -0,0 +1,177 @@
+/*
+* Copyright (c) 2007, ai-chan
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the ASSDraw3 Team nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY AI-CHAN ``AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL AI-CHAN BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+///////////////////////////////////////////////////////////////////////////////
+// Name:        layerthread.cpp
+// Purpose:     the thread drawing the background and shape layers of the canvas
+// Author:      ai-chan
+// Created:     08/26/06
+// Copyright:   (c) ai-chan
+// Licence:     3-clause BSD
+///////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <algorithm>
+
+#include "layerthread.hpp"
+#include "canvas.hpp"
+
+DEFINE_EVENT_TYPE(wxEVT_SHAPELAYER_DONE)
+
+FadedBackground* FadedBackground::Ref()
+{
+	wxMutexLocker lock(mutex);
+	refs++;
+	return this;
+}
+
+void FadedBackground::Unref()
+{
+	bool last;
+	{
+		wxMutexLocker lock(mutex);
+		last = --refs == 0;
+	}
+	if (last)
+		delete this;
+}
+
+wxThread::ExitCode ShapeLayerThread::Entry()
+{
+	for (;;)
+	{
+		ShapeLayerJob* job;
+		{
+			wxMutexLocker lock(mutex);
+			while (todo == NULL && !quit)
+				cond.Wait();
+			if (quit)
+				return 0;
+			job = todo;
+			todo = NULL;
+		}
+
+		DrawBackground(job);
+
+		if (job->cmds != parsed)
+		{
+			renderer.ParseBinary(job->cmds);
+			parsed = job->cmds;
+		}
+		renderer._PointSystem()->Set(job->scale / job->reduce, job->originx / job->reduce, job->originy / job->reduce);
+		renderer.curve_quality = job->curve_quality;
+		renderer.fill_threads = job->fill_threads;
+		renderer.job = job;
+		int stride = job->width * ASSDrawRenderer::PixelFormat::AGGType::pix_width;
+		agg::rendering_buffer rbuf(&job->pixels[0], job->width, job->height, stride);
+		ASSDrawRenderer::PixelFormat::AGGType pixf(rbuf);
+		agg::renderer_base<ASSDrawRenderer::PixelFormat::AGGType> rbase(pixf);
+		for (size_t i = 0; i < job->dirty.size(); i++)
+		{
+			// the shape goes over the background
+			const wxRect& r = job->dirty[i];
+			agg::rect_i clip(r.x, r.y, r.GetRight(), r.GetBottom());
+			rbase.copy_from(bgbuf, &clip, 0, 0);
+			if (job->reduce > 1)
+			{
+				RenderReduced(job, rbuf, r);
+				continue;
+			}
+			renderer.Render(rbuf, &clip);
+		}
+
+		{
+			wxMutexLocker lock(mutex);
+			if (quit)
+			{
+				delete job;
+				return 0;
+			}
+			delete done;
+			done = job;
+		}
+		wxCommandEvent event(wxEVT_SHAPELAYER_DONE);
+		wxPostEvent(owner, event);
+	}
+}
+
+void ShapeLayerThread::DrawBackground(ShapeLayerJob* job)
+{
+	const int pw = ASSDrawRenderer::PixelFormat::AGGType::pix_width;
+	std::vector<wxRect> all;
+	const std::vector<wxRect>* dirty = &job->bgdirty;
+	if ((int) bgbuf.width() != job->width || (int) bgbuf.height() != job->height)
+	{
+		// a new size, which the canvas draws all over again anyway
+		background.resize(job->width * job->height * pw);
+		bgbuf.attach(&background[0], job->width, job->height, job->width * pw);
+		all.push_back(wxRect(0, 0, job->width, job->height));
+		dirty = &all;
+	}
+	else
+		GUI::AGGWindow::scrollBuffer(bgbuf, job->bgdx, job->bgdy);
+
+	ASSDrawRenderer::PixelFormat::AGGType pixf(bgbuf);
+	agg::renderer_base<ASSDrawRenderer::PixelFormat::AGGType> rbase(pixf);
+	for (size_t i = 0; i < dirty->size(); i++)
+	{
+		const wxRect& r = (*dirty)[i];
+		rbase.clip_box(r.x, r.y, r.GetRight(), r.GetBottom());
+		rbase.copy_bar(r.x, r.y, r.GetRight(), r.GetBottom(), job->bgcolor);
+		if (job->bgimage)
+			ASSDrawCanvas::RenderBackgroundImage(rbase, bgras, bgsl, bgspans, job->bgimage->level[job->bglevel], job->bgimage_mtx, job->bgpath, job->bgpath_mtx, job->bgdraft);
+	}
+}
+
+void ShapeLayerThread::RenderReduced(ShapeLayerJob* job, agg::rendering_buffer& rbuf, const wxRect& r)
+{
+	const int pw = ASSDrawRenderer::PixelFormat::AGGType::pix_width;
+	int n = job->reduce;
+	int w = (job->width + n - 1) / n, h = (job->height + n - 1) / n;
+	reduced.resize(w * h * pw);
+	agg::rendering_buffer small(&reduced[0], w, h, w * pw);
+	agg::rect_i clip(r.x / n, r.y / n, r.GetRight() / n, r.GetBottom() / n);
+
+	// what's under the shape: a pixel from inside r for every small one
+	for (int y = clip.y1; y <= clip.y2; y++)
+	{
+		const agg::int8u* src = rbuf.row_ptr(std::min(std::max(y * n, r.y), r.GetBottom()));
+		agg::int8u* dst = small.row_ptr(y);
+		for (int x = clip.x1; x <= clip.x2; x++)
+			memcpy(dst + x * pw, src + std::min(std::max(x * n, r.x), r.GetRight()) * pw, pw);
+	}
+
+	renderer.Render(small, &clip);
+
+	// and every small pixel back as n x n of them
+	for (int y = r.y; y <= r.GetBottom(); y++)
+	{
+		const agg::int8u* src = small.row_ptr(y / n);
+		agg::int8u* dst = rbuf.row_ptr(y);
+		for (int x = r.x; x <= r.GetRight(); x++)
+			memcpy(dst + x * pw, src + x / n * pw, pw);
+	}
+}
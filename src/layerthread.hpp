@@ -0,0 +1,177 @@
+/*
+* Copyright (c) 2007, ai-chan
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the ASSDraw3 Team nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY AI-CHAN ``AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL AI-CHAN BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+///////////////////////////////////////////////////////////////////////////////
+// Name:        layerthread.hpp
+// Purpose:     header file for the thread drawing the canvas layers
+// Author:      ai-chan
+// Created:     08/26/06
+// Copyright:   (c) ai-chan
+// Licence:     3-clause BSD
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "renderer.hpp"
+
+#include <agg_span_allocator.h>
+
+// posted to the canvas when ShapeLayerThread has drawn a job
+DECLARE_EVENT_TYPE(wxEVT_SHAPELAYER_DONE, -1)
+
+// the background image faded towards the canvas colour, at full size and at every mip
+// level; it is never written to once made, so every fade makes a new one, and a job
+// holds a reference to the one it draws from until it's deleted
+class FadedBackground
+{
+public:
+	FadedBackground(size_t levels) : level(levels), pixels(levels), refs(1) { }
+
+	// one more holder, for it to Unref() when done with it
+	FadedBackground* Ref();
+	// deletes it after the last holder is done with it
+	void Unref();
+
+	// level 0 is the full image, every one after it half the size of the one before
+	std::vector<agg::rendering_buffer> level;
+	std::vector< std::vector<agg::int8u> > pixels;
+
+private:
+	~FadedBackground() { }
+
+	wxMutex mutex;
+	int refs;
+};
+
+// everything the background and shape layers are drawn from, copied (or held, for the
+// image) so the thread never touches the canvas
+struct ShapeLayerJob
+{
+	ShapeLayerJob() : bgimage(NULL) { }
+	~ShapeLayerJob() { if (bgimage) bgimage->Unref(); }
+
+	// the drawing, encoded with ASSDrawShape::GenerateBinary
+	std::string cmds;
+	double scale, originx, originy;
+	int curve_quality, fill_threads;
+	// drawn at 1/reduce of the resolution and scaled up, for a draft
+	int reduce;
+	agg::rgba fill, guideline, outline;
+	bool outlines;
+	// the layer as it was, with the parts in dirty to be drawn again
+	std::vector<agg::int8u> pixels;
+	int width, height;
+	std::vector<wxRect> dirty;
+
+	// the background layer: how far it has scrolled since the last job, the parts of it to
+	// draw again and what with; bgimage is NULL if there is no image, else the job's own
+	// reference to it, drawn from level bglevel
+	int bgdx, bgdy;
+	std::vector<wxRect> bgdirty;
+	ASSDrawRenderer::PixelFormat::AGGType::color_type bgcolor;
+	FadedBackground *bgimage;
+	size_t bglevel;
+	agg::trans_affine bgimage_mtx, bgpath_mtx;
+	agg::path_storage bgpath;
+	bool bgdraft;
+};
+
+// draws the fill and the outlines of a job over what's in the buffer
+class ShapeLayerRenderer : public ASSDrawRenderer
+{
+public:
+	ShapeLayerJob *job;
+
+protected:
+	virtual void DoDraw(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx)
+	{
+		Draw_Draw(rbase, rprim, rsolid, mtx, job->fill);
+		if (job->outlines)
+			Draw_Outlines(rsolid, job->guideline, job->outline);
+	}
+};
+
+// draws the background and shape layers of the canvas, one job at a time
+class ShapeLayerThread : public wxThread
+{
+public:
+	ShapeLayerThread(wxEvtHandler* o) : wxThread(wxTHREAD_JOINABLE), owner(o), cond(mutex), todo(NULL), done(NULL), quit(false) { }
+	~ShapeLayerThread() { delete todo; delete done; }
+
+	// draw job, which the thread takes over; owner gets a wxEVT_SHAPELAYER_DONE when it's done
+	void Submit(ShapeLayerJob* job)
+	{
+		wxMutexLocker lock(mutex);
+		delete todo;
+		todo = job;
+		cond.Signal();
+	}
+
+	// the job that was drawn, for the caller to take over (NULL if there isn't one)
+	ShapeLayerJob* Take()
+	{
+		wxMutexLocker lock(mutex);
+		ShapeLayerJob* job = done;
+		done = NULL;
+		return job;
+	}
+
+	// stop as soon as the job being drawn is finished
+	void Quit()
+	{
+		wxMutexLocker lock(mutex);
+		quit = true;
+		cond.Signal();
+	}
+
+protected:
+	virtual ExitCode Entry();
+
+	wxEvtHandler *owner;
+	wxMutex mutex;
+	wxCondition cond;
+	ShapeLayerJob *todo, *done;
+	bool quit;
+
+	ShapeLayerRenderer renderer;
+	// what renderer has been given to draw, so it's only parsed (and flattened) again when it changes
+	std::string parsed;
+
+	// draw the part r of the job's pixels at 1/job->reduce of the resolution
+	void RenderReduced(ShapeLayerJob* job, agg::rendering_buffer& rbuf, const wxRect& r);
+	std::vector<agg::int8u> reduced;
+
+	// the background layer, kept here and brought up to date with every job
+	void DrawBackground(ShapeLayerJob* job);
+	std::vector<agg::int8u> background;
+	agg::rendering_buffer bgbuf;
+	agg::rasterizer_scanline_aa<> bgras;
+	agg::scanline_p8 bgsl;
+	agg::span_allocator<ASSDrawRenderer::PixelFormat::AGGType::color_type> bgspans;
+};
@@ -115,6 +115,8 @@ ASSDrawShapePreview* ASSDrawShapeLibrary::AddShapePreview(wxString cmds, bool ad
 	prev->Connect(wxEVT_LEFT_DCLICK, wxMouseEventHandler(ASSDrawShapeLibrary::OnMouseLeftDClick), NULL, this);
 	prev->Connect(wxEVT_RIGHT_UP, wxMouseEventHandler(ASSDrawShapeLibrary::OnMouseRightClick), NULL, this);
 	ASSDrawFrame::wxColourToAggRGBA(m_frame->colors.library_shape, prev->rgba_shape);
+	prev->curve_quality = m_frame->performance.curvequality;
+	prev->frame_cap = m_frame->performance.framecap;
 	if (addtotop)
 		sizer->Insert(0, prev, 1, wxEXPAND | wxTOP | wxLEFT | wxRIGHT, 5);
 	else
@@ -193,10 +195,14 @@ void ASSDrawShapeLibrary::OnPopupMenuClicked(wxCommandEvent &event)
 			}
 			break;
 		case MENU_SAVECANVAS:
-			activepreview->ParseASS(m_frame->m_canvas->GenerateASS());
+		{
+			std::string drawing;
+			m_frame->m_canvas->GenerateBinary(drawing);
+			activepreview->ParseBinary(drawing);
 			activepreview->SetFitToViewPointOnNextPaint();
 			activepreview->RefreshDisplay();
 			break;
+		}
 		case MENU_DELETE:
 			sizer->Detach(activepreview);
 			activepreview->Show(false);
@@ -209,7 +215,11 @@ void ASSDrawShapeLibrary::OnPopupMenuClicked(wxCommandEvent &event)
 
 void ASSDrawShapeLibrary::SaveShapeFromCanvas(wxCommandEvent& WXUNUSED(event))
 {
-	AddShapePreview(m_frame->m_canvas->GenerateASS(), true);
+	std::string drawing;
+	m_frame->m_canvas->GenerateBinary(drawing);
+	ASSDrawShapePreview *prev = AddShapePreview(_T(""), true);
+	if (prev->ParseBinary(drawing) > 0)
+		prev->SetFitToViewPointOnNextPaint(5, 5);
 }
 
 void ASSDrawShapeLibrary::CheckUncheckAllPreviews(wxCommandEvent &event)
@@ -257,8 +267,10 @@ std::vector< ASSDrawShapePreview *> ASSDrawShapeLibrary::GetShapePreviews()
 
 void ASSDrawShapeLibrary::LoadToCanvas(ASSDrawShapePreview *preview)
 {
+	std::string drawing;
+	preview->GenerateBinary(drawing);
 	m_frame->m_canvas->AddUndo(_T("Load shape from library"));
-	m_frame->m_canvas->ParseASS(preview->GenerateASS());
+	m_frame->m_canvas->ParseBinary(drawing);
 	m_frame->m_canvas->RefreshDisplay();
 	m_frame->m_canvas->RefreshUndocmds();
 	m_frame->UpdateFrameUI();
@@ -0,0 +1,720 @@
+/*
+* Copyright (c) 2007, ai-chan
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the ASSDraw3 Team nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY AI-CHAN ``AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL AI-CHAN BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+///////////////////////////////////////////////////////////////////////////////
+// Name:        renderer.cpp
+// Purpose:     ASSDraw shape renderer
+// Author:      ai-chan
+// Created:     08/26/06
+// Copyright:   (c) ai-chan
+// Licence:     3-clause BSD
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+#include <vector> // ok, we use vector too
+
+#include "renderer.hpp"
+
+
+#include "agg_conv_bcspline.h" //this header is local to our project
+#include <agg_array.h>
+#include <agg_bounding_rect.h>
+#include <agg_rasterizer_sl_clip.h>
+#include <agg_trans_bilinear.h>
+
+#include <wx/thread.h>
+
+// rows in one band of the threaded fill
+static const int FILL_BAND_HEIGHT = 32;
+// fills with fewer segments than this in the rows being drawn aren't worth the threads
+static const size_t FILL_MIN_LINES = 1024;
+
+// A fill split into bands of rows. Every band gets a rasterizer of its own, clipped to
+// its rows and fed the segments crossing them, so no band makes cells for rows it doesn't
+// draw; the bands don't overlap, so the workers can blend into the shared buffer without
+// locking. The clipper rounds where it cuts a segment at the edge of a band, so a pixel can
+// come out a few levels of coverage off the single-threaded fill
+class FillJob
+{
+public:
+	typedef ASSDrawRenderer::PixelFormat::AGGType PixFmt;
+
+	struct Segment
+	{
+		double x1, y1, x2, y2;
+		Segment(double _x1, double _y1, double _x2, double _y2) : x1(_x1), y1(_y1), x2(_x2), y2(_y2) { }
+	};
+
+	FillJob(PixFmt& p, const agg::rect_i& b, const agg::rgba& c) : pixf(p), box(b), color(c), next(0) { }
+
+	// rasterize and blend bands until there are none left
+	void Run();
+
+	PixFmt& pixf;
+	// the pixels to fill, inclusive; band i starts at row box.y1 + i * FILL_BAND_HEIGHT
+	agg::rect_i box;
+	// the columns the bands' rasterizers are clipped to
+	double clip_x1, clip_x2;
+	PixFmt::color_type color;
+
+	std::vector<Segment> segments;
+	// indices into segments of the ones crossing each band
+	std::vector< std::vector<size_t> > bands;
+
+	wxMutex mutex;
+	size_t next;
+};
+
+void FillJob::Run()
+{
+	agg::rasterizer_scanline_aa<> ras;
+	agg::scanline_p8 sl;
+	agg::renderer_base<PixFmt> rbase(pixf);
+	for (;;)
+	{
+		size_t b;
+		{
+			wxMutexLocker lock(mutex);
+			b = next++;
+		}
+		if (b >= bands.size())
+			break;
+
+		int y1 = box.y1 + (int) b * FILL_BAND_HEIGHT;
+		int y2 = std::min(y1 + FILL_BAND_HEIGHT - 1, box.y2);
+		rbase.clip_box(box.x1, y1, box.x2, y2);
+		// which resets ras as well
+		ras.clip_box(clip_x1, y1, clip_x2, y2 + 1);
+		const std::vector<size_t>& band = bands[b];
+		for (size_t i = 0; i < band.size(); i++)
+		{
+			const Segment& s = segments[band[i]];
+			ras.edge_d(s.x1, s.y1, s.x2, s.y2);
+		}
+		agg::render_scanlines_aa_solid(ras, sl, rbase, color);
+	}
+}
+
+// Worker threads a renderer keeps between fills, so that a fill doesn't have to start
+// and join threads of its own; they sleep until Run() hands them a job
+class FillPool
+{
+public:
+	FillPool() : wake(mutex), done(mutex), job(NULL), generation(0), wanted(0), taken(0), busy(0), quit(false) { }
+	~FillPool();
+
+	// run job on the calling thread and on up to threads - 1 workers, starting more of
+	// them if there aren't that many yet; returns when they're all done with it
+	void Run(FillJob& job, int threads);
+
+private:
+	class Worker : public wxThread
+	{
+	public:
+		Worker(FillPool& p) : wxThread(wxTHREAD_JOINABLE), pool(p) { }
+
+	protected:
+		virtual ExitCode Entry() { pool.Work(); return 0; }
+
+		FillPool& pool;
+	};
+	friend class Worker;
+
+	// what each worker does until the pool is destroyed
+	void Work();
+
+	std::vector<Worker*> workers;
+	wxMutex mutex;
+	wxCondition wake, done;
+	FillJob *job;
+	// goes up with every job, so that no worker takes the same one twice
+	unsigned long generation;
+	// workers the current job is for, how many have taken it and how many are still on it
+	int wanted, taken, busy;
+	bool quit;
+};
+
+FillPool::~FillPool()
+{
+	{
+		wxMutexLocker lock(mutex);
+		quit = true;
+		wake.Broadcast();
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i]->Wait();
+		delete workers[i];
+	}
+}
+
+void FillPool::Run(FillJob& j, int threads)
+{
+	while ((int) workers.size() < threads - 1)
+	{
+		Worker *worker = new Worker(*this);
+		if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR)
+		{
+			delete worker;
+			break;
+		}
+		workers.push_back(worker);
+	}
+
+	{
+		wxMutexLocker lock(mutex);
+		job = &j;
+		wanted = busy = std::min(threads - 1, (int) workers.size());
+		taken = 0;
+		generation++;
+		wake.Broadcast();
+	}
+	// this thread takes bands too, and does them all if no worker could be started
+	j.Run();
+
+	wxMutexLocker lock(mutex);
+	while (busy > 0)
+		done.Wait();
+	job = NULL;
+}
+
+void FillPool::Work()
+{
+	// a worker started after some jobs sees them as taken already
+	unsigned long seen = 0;
+	for (;;)
+	{
+		FillJob *j;
+		{
+			wxMutexLocker lock(mutex);
+			for (;;)
+			{
+				if (quit)
+					return;
+				if (generation != seen)
+				{
+					seen = generation;
+					if (taken < wanted)
+						break;
+				}
+				wake.Wait();
+			}
+			taken++;
+			j = job;
+		}
+
+		j->Run();
+
+		wxMutexLocker lock(mutex);
+		if (--busy == 0)
+			done.Signal();
+	}
+}
+
+// ----------------------------------------------------------------------------
+// ASSDrawRenderer
+// ----------------------------------------------------------------------------
+
+ASSDrawRenderer::ASSDrawRenderer()
+{
+	rgba_shape = agg::rgba(0,0,1);
+	color_bg = PixelFormat::AGGType::color_type(255, 255, 255);
+	rendered_min_x = rendered_min_y = rendered_max_x = rendered_max_y = 0;
+	render_clipped = false;
+	fill_threads = 1;
+	fill_pool = NULL;
+	curve_quality = 2;
+	paths_revision = 0;
+	paths_splinescale = 0;
+	paths_curvequality = 0;
+	paths_valid = false;
+}
+
+ASSDrawRenderer::~ASSDrawRenderer()
+{
+	delete fill_pool;
+}
+
+void ASSDrawRenderer::Render(agg::rendering_buffer& rbuf, const agg::rect_i* clip)
+{
+	PixelFormat::AGGType pixf(rbuf);
+	RendererBase rbase(pixf);
+	RendererPrimitives rprim(rbase);
+	RendererSolid rsolid(rbase);
+
+	agg::trans_affine mtx;
+	ConstructPathsAndCurves(mtx, rm_path, rb_path, rm_curve);
+
+	SetClip(rbase, clip);
+	rasterizer.reset();
+	UpdateRenderedBoundCoords(true);
+	DoDraw(rbase, rprim, rsolid, mtx);
+	SetClip(rbase, NULL);
+
+	delete rm_path;
+	delete rb_path;
+	delete rm_curve;
+}
+
+bool ASSDrawRenderer::GetBounds(double& x1, double& y1, double& x2, double& y2)
+{
+	agg::trans_affine mtx;
+	ConstructPathsAndCurves(mtx, rm_path, rb_path, rm_curve);
+	// in pixels, so the curves are flattened the way Render would
+	bool found = agg::bounding_rect_single(*rm_curve, 0, &x1, &y1, &x2, &y2);
+	delete rm_path;
+	delete rb_path;
+	delete rm_curve;
+	if (!found || x1 > x2 || y1 > y2)
+		return false;
+
+	x1 = (x1 - pointsys->originx) / pointsys->scale;
+	y1 = (y1 - pointsys->originy) / pointsys->scale;
+	x2 = (x2 - pointsys->originx) / pointsys->scale;
+	y2 = (y2 - pointsys->originy) / pointsys->scale;
+	return true;
+}
+
+void ASSDrawRenderer::FitTo(int width, int height, int hmargin, int vmargin)
+{
+	double x1, y1, x2, y2;
+	if (!GetBounds(x1, y1, x2, y2))
+		return;
+
+	// a single point or a line along an axis only limits the scale the other way
+	double wide = x2 - x1, high = y2 - y1;
+	double widthratio = wide > 0? std::max(width - hmargin * 2, 1) / wide:-1;
+	double heightratio = high > 0? std::max(height - vmargin * 2, 1) / high:-1;
+	double scale = widthratio < 0 || (heightratio >= 0 && heightratio < widthratio)? heightratio:widthratio;
+	if (scale < 0.01)
+		scale = scale < 0? pointsys->scale:0.01;
+
+	pointsys->Set(scale, (width - wide * scale) / 2 - x1 * scale, (height - high * scale) / 2 - y1 * scale);
+}
+
+void ASSDrawRenderer::SetClip(RendererBase& rbase, const agg::rect_i* clip)
+{
+	render_clipped = clip != NULL && (clip->x1 > 0 || clip->y1 > 0 || clip->x2 < (int) rbase.width() - 1 || clip->y2 < (int) rbase.height() - 1);
+	if (render_clipped)
+	{
+		// the renderer does the exact clipping; the rasterizer skips the geometry
+		// outside, with a pixel to spare so the anti-aliased edges come out the same
+		rbase.clip_box(clip->x1, clip->y1, clip->x2, clip->y2);
+		rasterizer_clip = agg::rect_d(clip->x1 - 1, clip->y1 - 1, clip->x2 + 2, clip->y2 + 2);
+		rasterizer.clip_box(rasterizer_clip.x1, rasterizer_clip.y1, rasterizer_clip.x2, rasterizer_clip.y2);
+	}
+	else
+	{
+		rbase.reset_clipping(true);
+		rasterizer.reset_clipping();
+	}
+}
+
+void ASSDrawRenderer::ConstructPathsAndCurves(agg::trans_affine& mtx, ConvTransAffine*& _rm_path, ConvTransAffine*& _rb_path, ConvCurveTransAffine*& _rm_curve)
+{
+	mtx *= agg::trans_affine_scaling(pointsys->scale);
+	mtx *= agg::trans_affine_translation(pointsys->originx, pointsys->originy);
+
+	if (!paths_valid || paths_revision != pointsys->store.revision || paths_splinescale != SplineScale() || paths_curvequality != curve_quality)
+	{
+		m_path.remove_all();
+		b_path.remove_all();
+
+		DrawCmdList::iterator ci = cmds.begin();
+		while (ci != cmds.end())
+		{
+			AddDrawCmdToAGGPathStorage(*ci, m_path);
+			AddDrawCmdToAGGPathStorage(*ci, b_path, CTRL_LN);
+			ci++;
+		}
+		paths_revision = pointsys->store.revision;
+		paths_splinescale = SplineScale();
+		paths_curvequality = curve_quality;
+		paths_valid = true;
+	}
+	_rm_path = new ConvTransAffine(m_path, mtx);
+	_rb_path = new ConvTransAffine(b_path, mtx);
+	_rm_curve = new ConvCurveTransAffine(*_rm_path);
+	// B curves are flattened after the transformation, so in pixels already
+	if (curve_quality > 0)
+		_rm_curve->approximation_scale(curve_quality / 2.0);
+}
+
+double ASSDrawRenderer::SplineScale()
+{
+	if (curve_quality <= 0)
+		return 0;
+	int e;
+	frexp(pointsys->scale, &e);
+	return ldexp(1.0, e);
+}
+
+double ASSDrawRenderer::SplineStep(const double* pts, unsigned np)
+{
+	double scale = SplineScale();
+	if (scale == 0)
+		return 0.01;
+
+	// AGG's spline through the points (at abscissae 0, 1, 2, ...) is the natural cubic one:
+	// its second derivatives M at the points solve M[i-1] + 4 M[i] + M[i+1] = 6 d[i], d[i]
+	// being the second differences of the points, with M 0 at both ends. Where |M| is largest
+	// that gives 4 |M| <= 6 |d[i]| + 2 |M|, so |M| <= 3 max |d|, and since the second derivative
+	// is linear between the points it's no larger anywhere else. A chord of parameter length h
+	// is then off the curve by at most 3 max |d| h^2 / 8 drawing units, which the h below makes
+	// 1 / (scale * curve_quality), and scale is at least the zoom; rounding h down to a power
+	// of 2 only makes the chords closer, the 1/1024 floor is the one place the bound can break
+	double d2 = 0;
+	for (unsigned i = 1; i + 1 < np; i++)
+	{
+		double dx = pts[i * 2 - 2] - 2 * pts[i * 2] + pts[i * 2 + 2];
+		double dy = pts[i * 2 - 1] - 2 * pts[i * 2 + 1] + pts[i * 2 + 3];
+		d2 = std::max(d2, sqrt(dx * dx + dy * dy));
+	}
+	if (d2 == 0)
+		return 1.0;
+	double h = sqrt(8.0 / (3.0 * d2 * scale * curve_quality));
+	if (h >= 1.0)
+		return 1.0;
+	if (h <= 1.0 / 1024)
+		return 1.0 / 1024;
+	// a power of 2, so the abscissae add up exactly
+	int e;
+	frexp(h, &e);
+	return ldexp(1.0, e - 1);
+}
+
+void ASSDrawRenderer::DoDraw(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx)
+{
+	Draw_Clear(rbase);
+	Draw_Draw(rbase, rprim, rsolid, mtx, rgba_shape);
+}
+
+void ASSDrawRenderer::Draw_Clear(RendererBase& rbase)
+{
+	// unlike clear(), copy_bar() stays inside the clip box
+	rbase.copy_bar(rbase.xmin(), rbase.ymin(), rbase.xmax(), rbase.ymax(), color_bg);
+}
+
+void ASSDrawRenderer::Draw_Draw(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx, agg::rgba color)
+{
+	agg::conv_contour<ConvCurveTransAffine> contour(*rm_curve);
+	int threads = fill_threads > 0? fill_threads:wxThread::GetCPUCount();
+	if (threads > 1 && rbase.ymax() - rbase.ymin() + 1 >= 2 * FILL_BAND_HEIGHT)
+		FillThreaded(rbase, contour, color, threads);
+	else
+	{
+		rasterizer.add_path(contour);
+		render_scanlines_aa_solid(rbase, color);
+	}
+}
+
+void ASSDrawRenderer::Draw_Outlines(RendererSolid& rsolid, agg::rgba guideline, agg::rgba outline)
+{
+	agg::conv_stroke<ConvTrans> bguidestroke(*rb_path);
+	bguidestroke.width(1);
+	rsolid.color(guideline);
+	rasterizer.add_path(bguidestroke);
+	render_scanlines(rsolid);
+
+	agg::conv_stroke<ConvCurveTransAffine> stroke(*rm_curve);
+	stroke.width(1);
+	rsolid.color(outline);
+	rasterizer.add_path(stroke);
+	render_scanlines(rsolid);
+}
+
+void ASSDrawRenderer::FillThreaded(RendererBase& rbase, agg::conv_contour<ConvCurveTransAffine>& contour, agg::rgba color, int threads)
+{
+	agg::rect_i box(rbase.xmin(), rbase.ymin(), rbase.xmax(), rbase.ymax());
+	FillJob job(rbase.ren(), box, color);
+
+	// the line segments add_path() would give the rasterizer, closing every polygon
+	std::vector<FillJob::Segment>& segments = job.segments;
+	double sx = 0, sy = 0, cx = 0, cy = 0, x, y;
+	bool open = false;
+	unsigned cmd;
+	contour.rewind(0);
+	for (;;)
+	{
+		cmd = contour.vertex(&x, &y);
+		if ((agg::is_move_to(cmd) || agg::is_close(cmd) || agg::is_stop(cmd)) && open)
+		{
+			segments.push_back(FillJob::Segment(cx, cy, sx, sy));
+			cx = sx, cy = sy;
+			open = false;
+		}
+		if (agg::is_stop(cmd))
+			break;
+		if (agg::is_move_to(cmd))
+			sx = cx = x, sy = cy = y;
+		else if (agg::is_vertex(cmd))
+		{
+			segments.push_back(FillJob::Segment(cx, cy, x, y));
+			cx = x, cy = y;
+			open = true;
+		}
+	}
+
+	// a segment goes to every band its rows fall in; meanwhile count the segments in the
+	// rows being drawn and work out the rasterizer's bounds: the cells the ends are in
+	int nbands = (box.y2 - box.y1) / FILL_BAND_HEIGHT + 1;
+	job.bands.resize(nbands);
+	size_t inside = 0;
+	int min_x = INT_MAX, min_y = INT_MAX, max_x = INT_MIN, max_y = INT_MIN;
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		const FillJob::Segment& s = segments[i];
+		int cx1 = agg::ras_conv_int::upscale(s.x1) >> agg::poly_subpixel_shift, cy1 = agg::ras_conv_int::upscale(s.y1) >> agg::poly_subpixel_shift;
+		int cx2 = agg::ras_conv_int::upscale(s.x2) >> agg::poly_subpixel_shift, cy2 = agg::ras_conv_int::upscale(s.y2) >> agg::poly_subpixel_shift;
+		min_x = std::min(min_x, std::min(cx1, cx2)), max_x = std::max(max_x, std::max(cx1, cx2));
+		min_y = std::min(min_y, std::min(cy1, cy2)), max_y = std::max(max_y, std::max(cy1, cy2));
+
+		int top = std::min(cy1, cy2), bottom = std::max(cy1, cy2);
+		if (bottom < box.y1 || top > box.y2)
+			continue;
+		inside++;
+		int first = (std::max(top, box.y1) - box.y1) / FILL_BAND_HEIGHT;
+		int last = (std::min(bottom, box.y2) - box.y1) / FILL_BAND_HEIGHT;
+		for (int b = first; b <= last; b++)
+			job.bands[b].push_back(i);
+	}
+
+	// same segments on this thread, same result
+	if (inside < FILL_MIN_LINES)
+	{
+		for (size_t i = 0; i < segments.size(); i++)
+		{
+			const FillJob::Segment& s = segments[i];
+			rasterizer.edge_d(s.x1, s.y1, s.x2, s.y2);
+		}
+		render_scanlines_aa_solid(rbase, color);
+		return;
+	}
+
+	// the bands are clipped to columns only where rasterizer is, else they reach past
+	// every segment so none is cut at the sides
+	if (render_clipped)
+		job.clip_x1 = rasterizer_clip.x1, job.clip_x2 = rasterizer_clip.x2;
+	else
+		job.clip_x1 = min_x, job.clip_x2 = max_x + 1;
+
+	if (fill_pool == NULL)
+		fill_pool = new FillPool();
+	fill_pool->Run(job, std::min(threads, nbands));
+
+	// leave rasterizer as empty as add_path() + render would have for the next user
+	rasterizer.reset();
+	UpdateRenderedBoundCoords(min_x, min_y, max_x, max_y);
+}
+
+void ASSDrawRenderer::AddDrawCmdToAGGPathStorage(DrawCmd* cmd, agg::path_storage& path, DRAWCMDMODE mode)
+{
+	if (mode == HILITE && cmd->prev)
+		path.move_to(cmd->prev->m_point->x(), cmd->prev->m_point->y());
+
+	switch(cmd->type)
+	{
+		case M:
+		{
+			path.move_to(cmd->m_point->x(),cmd->m_point->y());
+			break;
+		}
+		case L:
+		{
+			if (mode == CTRL_LN)
+				path.move_to(cmd->m_point->x(),cmd->m_point->y());
+			else
+				path.line_to(cmd->m_point->x(),cmd->m_point->y());
+			break;
+		}
+		case B:
+		{
+			if (cmd->initialized)
+			{
+				//path.move_to(cmd->prev->m_point->x(),cmd->prev->m_point->y());
+				PointList::iterator iterate = cmd->controlpoints.begin();
+				int x[2], y[2];
+				x[0] = (*iterate)->x();
+				y[0] = (*iterate)->y();
+				iterate++;
+				x[1] = (*iterate)->x();
+				y[1] = (*iterate)->y();
+				path.curve4(x[0], y[0], x[1], y[1], cmd->m_point->x(),cmd->m_point->y());
+			}
+			break;
+		}
+		case S:
+		{
+			if (mode == CTRL_LN)
+			{
+				PointList::iterator iterate = cmd->controlpoints.begin();
+				while (iterate != cmd->controlpoints.end())
+				{
+					path.line_to((*iterate)->x(), (*iterate)->y());
+					iterate++;
+				}
+				path.line_to(cmd->m_point->x(), cmd->m_point->y());
+			}
+			else
+			{
+				// the spline only depends on the control points, so it's kept with the command
+				DrawCmd_S *s = static_cast<DrawCmd_S*>(cmd);
+				unsigned np = cmd->controlpoints.size();
+				agg::pod_array<double> m_polygon(np * 2);
+				unsigned _pn = 0;
+				PointList::iterator iterate = cmd->controlpoints.begin();
+				while (iterate != cmd->controlpoints.end())
+				{
+					m_polygon[_pn] = (*iterate)->x();
+					_pn++;
+					m_polygon[_pn] = (*iterate)->y();
+					_pn++;
+					iterate++;
+				}
+				double step = SplineStep(&m_polygon[0], np);
+				if (s->IsGeometryDirty() || s->splinecmds.empty() || s->splinestep != step)
+				{
+					aggpolygon poly(&m_polygon[0], np, false, false);
+					agg::conv_bcspline<agg::simple_polygon_vertex_source>  bspline(poly);
+					bspline.interpolation_step(step);
+					s->splinestep = step;
+					agg::path_storage npath;
+					npath.join_path(bspline);
+					s->splinexy.resize(npath.total_vertices() * 2);
+					s->splinecmds.resize(npath.total_vertices());
+					for (unsigned i = 0; i < npath.total_vertices(); i++)
+						s->splinecmds[i] = npath.vertex(i, &s->splinexy[i * 2], &s->splinexy[i * 2 + 1]);
+					s->SetGeometryDirty(false);
+				}
+				agg::saved_vertex_source spline(s->splinexy, s->splinecmds);
+				path.join_path(spline);
+				if (mode == HILITE)
+					path.move_to(cmd->controlpoints.back()->x(), cmd->controlpoints.back()->y());
+				path.line_to(cmd->m_point->x(), cmd->m_point->y());
+			}
+			break;
+		}
+	}
+}
+
+void ASSDrawRenderer::render_scanlines_aa_solid(RendererBase& rbase, agg::rgba rgba, bool affectboundaries)
+{
+	agg::render_scanlines_aa_solid(rasterizer, scanline, rbase, rgba);
+	if (affectboundaries)
+		UpdateRenderedBoundCoords();
+}
+
+void ASSDrawRenderer::render_scanlines(RendererSolid& rsolid, bool affectboundaries)
+{
+	agg::render_scanlines(rasterizer, scanline, rsolid);
+	if (affectboundaries)
+		UpdateRenderedBoundCoords();
+}
+
+void ASSDrawRenderer::UpdateRenderedBoundCoords(bool rendered_fresh)
+{
+	// the rasterizer only saw part of the drawing
+	if (render_clipped)
+		return;
+	int min_x = rasterizer.min_x();
+	int min_y = rasterizer.min_y();
+	int max_x = rasterizer.max_x();
+	int max_y = rasterizer.max_y();
+	if (rendered_fresh)
+	{
+		rendered_min_x = min_x, rendered_min_y = min_y;
+		rendered_max_x = max_x, rendered_max_y = max_y;
+	}
+	else
+		UpdateRenderedBoundCoords(min_x, min_y, max_x, max_y);
+}
+
+void ASSDrawRenderer::UpdateRenderedBoundCoords(int min_x, int min_y, int max_x, int max_y)
+{
+	if (render_clipped)
+		return;
+	if (min_x < rendered_min_x)
+		rendered_min_x = min_x;
+	if (min_y < rendered_min_y)
+		rendered_min_y = min_y;
+	if (max_x > rendered_max_x)
+		rendered_max_x = max_x;
+	if (max_y > rendered_max_y)
+		rendered_max_y = max_y;
+}
+
+void ASSDrawRenderer::BackupPoints(agg::path_storage& backup)
+{
+	backup.free_all();
+	for (DrawCmdList::iterator iterate = cmds.begin(); iterate != cmds.end(); iterate++)
+	{
+		DrawCmd* cmd = (*iterate);
+		for (PointList::iterator iterate2 = cmd->controlpoints.begin(); iterate2 != cmd->controlpoints.end(); iterate2++)
+		{
+			wxPoint pp = (*iterate2)->ToWxPoint();
+			backup.move_to(pp.x, pp.y);
+		}
+		wxPoint pp = (*iterate)->m_point->ToWxPoint();
+		backup.move_to(pp.x, pp.y);
+	}
+}
+
+void ASSDrawRenderer::TransformPointsBilinear(agg::path_storage& backup, double x1, double y1, double x2, double y2, const double *quad)
+{
+	agg::path_storage trans;
+	unsigned vertices = backup.total_vertices();
+
+	agg::trans_bilinear trans_b(x1, y1, x2, y2, quad);
+	agg::conv_transform<agg::path_storage, agg::trans_bilinear> transb(backup, trans_b);
+	transb.rewind(0);
+	for (unsigned i = 0; i < vertices; i++)
+	{
+		double x, y;
+		transb.vertex(&x, &y);
+		trans.move_to(x, y);
+	}
+
+	trans.rewind(0);
+	for (DrawCmdList::iterator iterate = cmds.begin(); iterate != cmds.end(); iterate++)
+	{
+		DrawCmd* cmd = (*iterate);
+		for (PointList::iterator iterate2 = cmd->controlpoints.begin(); iterate2 != cmd->controlpoints.end(); iterate2++)
+		{
+			double x, y;
+			trans.vertex(&x, &y);
+			int wx, wy;
+			pointsys->FromWxPoint(wxPoint((int)x, (int)y), wx, wy);
+			(*iterate2)->setXY(wx, wy);
+		}
+		double x, y;
+		trans.vertex(&x, &y);
+		int wx, wy;
+		pointsys->FromWxPoint(wxPoint((int)x, (int)y), wx, wy);
+		(*iterate)->m_point->setXY(wx, wy);
+	}
+}
@@ -0,0 +1,236 @@
+/*
+* Copyright (c) 2007, ai-chan
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the ASSDraw3 Team nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY AI-CHAN ``AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL AI-CHAN BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+///////////////////////////////////////////////////////////////////////////////
+// Name:        renderer.hpp
+// Purpose:     header file for the ASSDraw shape renderer
+// Author:      ai-chan
+// Created:     08/26/06
+// Copyright:   (c) ai-chan
+// Licence:     3-clause BSD
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+
+#include "wx.hpp"
+#include "shape.hpp"
+
+#include <wx/rawbmp.h>
+
+// agg support
+#include "wxAGG/PixelFormatConvertor.h"
+
+#include <agg_color_rgba.h>
+#include <agg_rendering_buffer.h>
+#include <agg_rasterizer_scanline_aa.h>
+#include <agg_scanline_p.h>
+#include <agg_path_storage.h>
+#include <agg_renderer_base.h>
+#include <agg_renderer_primitives.h>
+#include <agg_renderer_scanline.h>
+#include <agg_trans_affine.h>
+#include <agg_conv_transform.h>
+#include <agg_conv_curve.h>
+#include <agg_conv_dash.h>
+#include <agg_conv_stroke.h>
+#include <agg_conv_contour.h>
+
+// threads for the fill, see renderer.cpp
+class FillPool;
+
+// Renders the shape with AGG into a rendering buffer of any size, at the scale and origin
+// of its pointsys; it doesn't need a window or a display, so it can also be used offscreen
+// (e.g. by assdraw_bench)
+class ASSDrawRenderer : public ASSDrawShape
+{
+public:
+	ASSDrawRenderer();
+	virtual ~ASSDrawRenderer();
+
+	typedef GUI::PixelFormatConvertor<wxNativePixelFormat> PixelFormat;
+
+	// draw everything into rbuf, which must be in PixelFormat::AGGType; if clip is given
+	// only the pixels inside it (inclusive) are drawn and the rest of rbuf is left alone
+	void Render(agg::rendering_buffer& rbuf, const agg::rect_i* clip = NULL);
+
+	// get the extent of the filled shape in drawing coordinates; false if nothing is filled
+	bool GetBounds(double& x1, double& y1, double& x2, double& y2);
+	// zoom and pan so the shape fills a width x height buffer but for hmargin and vmargin
+	// pixels at the sides; the shape needn't have been rendered first
+	void FitTo(int width, int height, int hmargin, int vmargin);
+
+	// save the GUI coordinates of all points to backup (control points of each command first)
+	void BackupPoints(agg::path_storage& backup);
+	// move all points to where the bilinear transformation of the rectangle (x1,y1)-(x2,y2) onto
+	// the quadrilateral quad (4 x,y pairs, clockwise from x1,y1) puts their coordinates in backup
+	void TransformPointsBilinear(agg::path_storage& backup, double x1, double y1, double x2, double y2, const double *quad);
+
+	// threads that rasterize the fill, a band of rows at a time; 1 fills on the calling
+	// thread, 0 uses one per CPU; the pixels come out the same either way
+	int fill_threads;
+
+	// curves are flattened to within 1 / curve_quality pixels on screen, whatever the zoom,
+	// unless an S would need more than 1024 vertices per span for that (see SplineStep for
+	// the bound); 0 flattens them the old fixed way (B with AGG's default accuracy, S with
+	// 100 vertices per span)
+	int curve_quality;
+
+	// Colours
+	agg::rgba rgba_shape;
+	PixelFormat::AGGType::color_type color_bg;
+
+protected:
+	typedef agg::renderer_base<PixelFormat::AGGType> RendererBase;
+	typedef agg::renderer_primitives<RendererBase> RendererPrimitives;
+	typedef agg::renderer_scanline_aa_solid<RendererBase> RendererSolid;
+
+	typedef agg::conv_transform<agg::path_storage> ConvTrans;
+
+	typedef agg::conv_transform<agg::path_storage, agg::trans_affine> ConvTransAffine;
+	typedef agg::conv_curve<ConvTransAffine> ConvCurveTransAffine;
+	typedef agg::conv_dash<ConvCurveTransAffine> ConvDashCurveTransAffine;
+
+	typedef agg::conv_curve<agg::path_storage> ConvCurve;
+	typedef agg::conv_dash<ConvCurve> ConvDashCurve;
+	typedef agg::conv_stroke<ConvDashCurve> ConvStrokeDashCurve;
+
+	enum DRAWCMDMODE {
+		NORMAL,
+		CTRL_LN,
+		HILITE
+	};
+
+	// scanline stuff
+	agg::rasterizer_scanline_aa<> rasterizer;
+	agg::scanline_p8  scanline;
+	void render_scanlines_aa_solid(RendererBase& rbase, agg::rgba rbga, bool affectboundaries = true);
+	void render_scanlines(RendererSolid& rsolid, bool affectboundaries = true);
+	int rendered_min_x, rendered_min_y, rendered_max_x, rendered_max_y;
+	void UpdateRenderedBoundCoords(bool rendered_fresh = false);
+	void UpdateRenderedBoundCoords(int min_x, int min_y, int max_x, int max_y);
+	// true while Render() draws only part of the buffer, which leaves the rendered bounds alone
+	bool render_clipped;
+	// draw only inside clip (inclusive) from now on, or everywhere if clip is NULL
+	void SetClip(RendererBase& rbase, const agg::rect_i* clip);
+	// what SetClip clipped the rasterizer to, while render_clipped
+	agg::rect_d rasterizer_clip;
+	// fill contour as rasterizer would, split into bands of rows shared by threads
+	void FillThreaded(RendererBase& rbase, agg::conv_contour<ConvCurveTransAffine>& contour, agg::rgba color, int threads);
+	// the worker threads FillThreaded uses, started the first time it needs them
+	FillPool *fill_pool;
+
+	// in drawing coordinates, so they're only rebuilt when the drawing's revision changes,
+	// not when it's zoomed or panned
+	agg::path_storage m_path;
+	agg::path_storage b_path;
+	unsigned long paths_revision;
+	double paths_splinescale;
+	int paths_curvequality;
+	bool paths_valid;
+	// the scale S splines are flattened for: pointsys->scale rounded up to a power of 2, so
+	// zooming within the same octave doesn't flatten them again (0 if curve_quality is 0)
+	double SplineScale();
+	// the parameter step that flattens the spline through the np points at pts well enough
+	double SplineStep(const double* pts, unsigned np);
+	ConvTransAffine *rm_path;
+	ConvTransAffine *rb_path;
+	ConvCurveTransAffine *rm_curve;
+
+	virtual void ConstructPathsAndCurves(agg::trans_affine& mtx, ConvTransAffine*& _rm_path, ConvTransAffine*& _rb_path, ConvCurveTransAffine*& _rm_curve);
+	virtual void DoDraw(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx);
+	virtual void Draw_Clear(RendererBase& rbase);
+	virtual void Draw_Draw(RendererBase& rbase, RendererPrimitives& rprim, RendererSolid& rsolid, agg::trans_affine& mtx, agg::rgba color);
+	// the outline of the shape, over the guide lines of its B curves
+	virtual void Draw_Outlines(RendererSolid& rsolid, agg::rgba guideline, agg::rgba outline);
+
+	virtual void AddDrawCmdToAGGPathStorage(DrawCmd* cmd, agg::path_storage& path, DRAWCMDMODE mode = NORMAL);
+};
+
+namespace agg
+{
+	class simple_polygon_vertex_source
+	{
+	public:
+		simple_polygon_vertex_source(const double* polygon, unsigned np, bool roundoff = false, bool close = true) : m_polygon(polygon), m_num_points(np), m_vertex(0), m_roundoff(roundoff), m_close(close) { }
+
+		void close(bool f) { m_close = f; }
+		bool close() const { return m_close; }
+
+		void rewind(unsigned) { m_vertex = 0; }
+
+		unsigned vertex(double* x, double* y)
+		{
+			if(m_vertex > m_num_points) return path_cmd_stop;
+			if(m_vertex == m_num_points)
+			{
+				++m_vertex;
+				return path_cmd_end_poly | (m_close ? path_flags_close : 0);
+			}
+			*x = m_polygon[m_vertex * 2];
+			*y = m_polygon[m_vertex * 2 + 1];
+			if(m_roundoff)
+			{
+				*x = floor(*x) + 0.5;
+				*y = floor(*y) + 0.5;
+			}
+			++m_vertex;
+			return (m_vertex == 1) ? path_cmd_move_to : path_cmd_line_to;
+		}
+
+	private:
+		const double* m_polygon;
+		unsigned m_num_points;
+		unsigned m_vertex;
+		bool     m_roundoff;
+		bool     m_close;
+	};
+
+	// replays vertices saved from another vertex source (x, y pairs and commands)
+	class saved_vertex_source
+	{
+	public:
+		saved_vertex_source(const std::vector<double>& xy, const std::vector<unsigned char>& cmds) : m_xy(xy), m_cmds(cmds), m_vertex(0) { }
+
+		void rewind(unsigned) { m_vertex = 0; }
+
+		unsigned vertex(double* x, double* y)
+		{
+			if(m_vertex >= m_cmds.size()) return path_cmd_stop;
+			*x = m_xy[m_vertex * 2];
+			*y = m_xy[m_vertex * 2 + 1];
+			return m_cmds[m_vertex++];
+		}
+
+	private:
+		const std::vector<double>& m_xy;
+		const std::vector<unsigned char>& m_cmds;
+		unsigned m_vertex;
+	};
+}
+
+typedef agg::simple_polygon_vertex_source aggpolygon;
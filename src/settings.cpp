@@ -53,13 +53,15 @@ void ASSDrawSettingsDialog::Init()
 	propgrid = new wxPropertyGrid(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxPG_TOOLTIPS | wxTAB_TRAVERSAL);
 
 	#define APPENDCOLOURPROP(pgid, label, color) pgid = propgrid->Append(new wxColourProperty(label, wxPG_LABEL, color));
-	#define APPENDUINTPROP(pgid, label, uint) \
+	#define APPENDUINTPROP(pgid, label, uint) APPENDRANGEDUINTPROP(pgid, label, uint, validator)
+	#define APPENDRANGEDUINTPROP(pgid, label, uint, range) \
 		pgid = propgrid->Append(new wxUIntProperty(label, wxPG_LABEL, uint)); \
-		propgrid->SetPropertyValidator(pgid, validator);
+		propgrid->SetPropertyValidator(pgid, range);
 	#define APPENDBOOLPROP(pgid, label, boolvar) \
 		pgid = propgrid->Append(new wxBoolProperty(label, wxPG_LABEL, boolvar)); \
 		propgrid->SetPropertyAttribute(pgid, wxPG_BOOL_USE_CHECKBOX, (long) 1);
 	wxLongPropertyValidator validator(0x0,0xFF);
+	wxLongPropertyValidator threadsvalidator(0, 64), fpsvalidator(0, 1000), msvalidator(0, 10000);
 
 	propgrid->Append(new wxPropertyCategory(_T("Appearance"), wxPG_LABEL));
 	APPENDCOLOURPROP(colors_canvas_bg_pgid, _T("Canvas"), m_frame->colors.canvas_bg)
@@ -92,6 +94,14 @@ void ASSDrawSettingsDialog::Init()
 	APPENDBOOLPROP(behaviors_nosplashscreen_pgid, _T("No splash screen"), m_frame->behaviors.nosplashscreen);
 	APPENDBOOLPROP(behaviors_confirmquit_pgid, _T("Confirm quit"), m_frame->behaviors.confirmquit);
 
+	propgrid->Append(new wxPropertyCategory(_T("Performance"), wxPG_LABEL));
+	APPENDRANGEDUINTPROP(performance_fillthreads_pgid, _T("Fill threads (0 = one per CPU)"), m_frame->performance.fillthreads, threadsvalidator)
+	APPENDUINTPROP(performance_curvequality_pgid, _T("Curve quality (0 = fixed)"), m_frame->performance.curvequality)
+	APPENDRANGEDUINTPROP(performance_framecap_pgid, _T("Frames per second (0 = no limit)"), m_frame->performance.framecap, fpsvalidator)
+	APPENDBOOLPROP(performance_draftdrag_pgid, _T("Draft while dragging"), m_frame->performance.draftdrag);
+	APPENDUINTPROP(performance_draftcurvequality_pgid, _T("Draft curve quality (0 = fixed)"), m_frame->performance.draftcurvequality)
+	APPENDRANGEDUINTPROP(performance_draftidle_pgid, _T("Draft idle ms (0 = until released)"), m_frame->performance.draftidle, msvalidator)
+
 	wxFlexGridSizer *sizer = new wxFlexGridSizer(2, 1, 0, 0);
 	sizer->AddGrowableCol(0);
 	sizer->AddGrowableRow(0);
@@ -157,6 +167,13 @@ void ASSDrawSettingsDialog::OnSettingsApplyButtonClicked(wxCommandEvent &event)
 
 	PARSE(&m_frame->sizes.origincross, sizes_origincross_pgid)
 
+	PARSE(&m_frame->performance.fillthreads, performance_fillthreads_pgid)
+	PARSE(&m_frame->performance.curvequality, performance_curvequality_pgid)
+	PARSE(&m_frame->performance.framecap, performance_framecap_pgid)
+	PARSE(&m_frame->performance.draftdrag, performance_draftdrag_pgid)
+	PARSE(&m_frame->performance.draftcurvequality, performance_draftcurvequality_pgid)
+	PARSE(&m_frame->performance.draftidle, performance_draftidle_pgid)
+
 	PARSE(&m_frame->behaviors.autoaskimgopac, behaviors_autoaskimgopac_pgid)
 	PARSE(&m_frame->behaviors.capitalizecmds, behaviors_capitalizecmds_pgid)
 	PARSE(&m_frame->behaviors.parse_spc, behaviors_parse_spc_pgid)
@@ -205,6 +222,13 @@ void ASSDrawSettingsDialog::RefreshSettingsDisplay()
 
 	UPDATESETTING(m_frame->sizes.origincross, sizes_origincross_pgid)
 
+	UPDATESETTING(m_frame->performance.fillthreads, performance_fillthreads_pgid)
+	UPDATESETTING(m_frame->performance.curvequality, performance_curvequality_pgid)
+	UPDATESETTING(m_frame->performance.framecap, performance_framecap_pgid)
+	UPDATESETTING(m_frame->performance.draftdrag, performance_draftdrag_pgid)
+	UPDATESETTING(m_frame->performance.draftcurvequality, performance_draftcurvequality_pgid)
+	UPDATESETTING(m_frame->performance.draftidle, performance_draftidle_pgid)
+
 	UPDATESETTING(m_frame->behaviors.capitalizecmds, behaviors_capitalizecmds_pgid)
 	UPDATESETTING(m_frame->behaviors.autoaskimgopac, behaviors_autoaskimgopac_pgid)
 	UPDATESETTING(m_frame->behaviors.parse_spc, behaviors_parse_spc_pgid)
@@ -76,6 +76,13 @@ public:
 
 	wxPGId sizes_origincross_pgid;
 
+	wxPGId performance_fillthreads_pgid;
+	wxPGId performance_curvequality_pgid;
+	wxPGId performance_framecap_pgid;
+	wxPGId performance_draftdrag_pgid;
+	wxPGId performance_draftcurvequality_pgid;
+	wxPGId performance_draftidle_pgid;
+
 	wxPGId behaviors_capitalizecmds_pgid;
 	wxPGId behaviors_autoaskimgopac_pgid;
 	wxPGId behaviors_parse_spc_pgid;
@@ -0,0 +1,1227 @@
+/*
+* Copyright (c) 2007, ai-chan
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the ASSDraw3 Team nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY AI-CHAN ``AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL AI-CHAN BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+///////////////////////////////////////////////////////////////////////////////
+// Name:        shape.cpp
+// Purpose:     ASSDraw drawing commands (GUI independent)
+// Author:      ai-chan
+// Created:     10/17/26
+// Copyright:   (c) ai-chan
+// Licence:     3-clause BSD
+///////////////////////////////////////////////////////////////////////////////
+
+#include <limits.h>
+#include <string.h>
+
+#include "shape.hpp"
+
+// ----------------------------------------------------------------------------
+// ASSBuffer
+// ----------------------------------------------------------------------------
+
+void ASSBuffer::AppendInt(int value)
+{
+	// digits are written backwards from the end of tmp; unsigned so INT_MIN negates fine
+	char tmp[16];
+	char *p = tmp + sizeof(tmp);
+	unsigned int u = value < 0? 0u - (unsigned int) value:(unsigned int) value;
+	do {
+		*--p = (char) ('0' + u % 10);
+		u /= 10;
+	} while (u != 0);
+	if (value < 0)
+		*--p = '-';
+	buf.append(p, tmp + sizeof(tmp) - p);
+}
+
+
+
+// ----------------------------------------------------------------------------
+// DrawPool
+// ----------------------------------------------------------------------------
+
+DrawPool::DrawPool()
+{
+	chunk = used = 0;
+	for (int i = 0; i < SIZECLASSES; i++)
+		freelist[i] = NULL;
+	live = 0;
+}
+
+DrawPool::~DrawPool()
+{
+	for (size_t i = 0; i < chunks.size(); i++)
+		::operator delete(chunks[i]);
+}
+
+void* DrawPool::Alloc(size_t size)
+{
+	size_t blocksize = (size + sizeof(Header) + GRANULARITY - 1) / GRANULARITY * GRANULARITY;
+	size_t sizeclass = blocksize / GRANULARITY;
+	Header *block;
+	if (sizeclass >= SIZECLASSES)
+	{
+		block = (Header *) ::operator new(blocksize);
+		block->pool = NULL;
+		return block + 1;
+	}
+
+	if (freelist[sizeclass] != NULL)
+	{
+		block = (Header *) freelist[sizeclass];
+		freelist[sizeclass] = freelist[sizeclass]->next;
+	}
+	else
+	{
+		if (chunk < chunks.size() && used + blocksize > CHUNKSIZE)
+		{
+			chunk++;
+			used = 0;
+		}
+		if (chunk == chunks.size())
+		{
+			chunks.push_back((char *) ::operator new(CHUNKSIZE));
+			stats.chunks++;
+		}
+		block = (Header *) (chunks[chunk] + used);
+		used += blocksize;
+	}
+
+	block->pool = this;
+	live++;
+	stats.allocs++;
+	return block + 1;
+}
+
+void DrawPool::Free(void *p, size_t size)
+{
+	if (p == NULL)
+		return;
+	Header *block = (Header *) p - 1;
+	if (block->pool == NULL)
+		::operator delete(block);
+	else
+		block->pool->Release(block, size);
+}
+
+void DrawPool::Release(Header *block, size_t size)
+{
+	stats.frees++;
+	// everything is back, free it all at once by cutting blocks from the first chunk again
+	if (--live == 0)
+	{
+		for (int i = 0; i < SIZECLASSES; i++)
+			freelist[i] = NULL;
+		chunk = used = 0;
+		return;
+	}
+	if (size == 0)
+		return;
+
+	size_t sizeclass = (size + sizeof(Header) + GRANULARITY - 1) / GRANULARITY;
+	FreeBlock *b = (FreeBlock *) block;
+	b->next = freelist[sizeclass];
+	freelist[sizeclass] = b;
+}
+
+
+
+// ----------------------------------------------------------------------------
+// DrawStore
+// ----------------------------------------------------------------------------
+
+unsigned int DrawStore::AddPoint(Point *point, int x, int y)
+{
+	unsigned int handle;
+	if (freepoints.empty())
+	{
+		handle = points.size();
+		points.push_back(point);
+		xy.push_back(x);
+		xy.push_back(y);
+		pointflags.push_back(POINT_LIVE);
+	}
+	else
+	{
+		handle = freepoints.back();
+		freepoints.pop_back();
+		points[handle] = point;
+		xy[handle * 2] = x;
+		xy[handle * 2 + 1] = y;
+		pointflags[handle] = POINT_LIVE;
+	}
+	livepoints++;
+	return handle;
+}
+
+void DrawStore::RemovePoint(unsigned int handle)
+{
+	points[handle] = NULL;
+	pointflags[handle] = 0;
+	// when the last point is gone start over from handle 0, keeping the memory
+	if (--livepoints == 0)
+	{
+		points.clear();
+		xy.clear();
+		pointflags.clear();
+		freepoints.clear();
+	}
+	else
+		freepoints.push_back(handle);
+}
+
+unsigned int DrawStore::AddCmd(DrawCmd *cmd)
+{
+	unsigned int handle;
+	if (freecmds.empty())
+	{
+		handle = cmds.size();
+		cmds.push_back(cmd);
+		cmdflags.push_back(CMD_LIVE | CMD_ASSDIRTY | CMD_GEOMDIRTY);
+	}
+	else
+	{
+		handle = freecmds.back();
+		freecmds.pop_back();
+		cmds[handle] = cmd;
+		cmdflags[handle] = CMD_LIVE | CMD_ASSDIRTY | CMD_GEOMDIRTY;
+	}
+	livecmds++;
+	return handle;
+}
+
+void DrawStore::RemoveCmd(unsigned int handle)
+{
+	cmds[handle] = NULL;
+	cmdflags[handle] = 0;
+	if (--livecmds == 0)
+	{
+		cmds.clear();
+		cmdflags.clear();
+		freecmds.clear();
+	}
+	else
+		freecmds.push_back(handle);
+}
+
+void DrawStore::Reserve(unsigned int npoints, unsigned int ncmds)
+{
+	xy.reserve(npoints * 2);
+	pointflags.reserve(npoints);
+	points.reserve(npoints);
+	cmdflags.reserve(ncmds);
+	cmds.reserve(ncmds);
+}
+
+void DrawStore::SetAllDirty()
+{
+	for (size_t i = 0, n = cmdflags.size(); i < n; i++)
+		if (cmdflags[i] & CMD_LIVE)
+			cmdflags[i] |= CMD_ASSDIRTY | CMD_GEOMDIRTY;
+	revision++;
+}
+
+bool DrawStore::AnyASSDirty() const
+{
+	for (size_t i = 0, n = cmdflags.size(); i < n; i++)
+		if (cmdflags[i] & CMD_ASSDIRTY)
+			return true;
+	return false;
+}
+
+bool DrawStore::PointInList(unsigned int h) const
+{
+	return (pointflags[h] & POINT_LIVE) && (cmdflags[points[h]->cmd_main->Handle()] & CMD_INLIST);
+}
+
+
+
+// ----------------------------------------------------------------------------
+// Point
+// ----------------------------------------------------------------------------
+
+Point::Point(int _x, int _y, PointSystem* ps, POINTTYPE t, DrawCmd* cmd, unsigned n)
+{
+	pointsys = ps;
+	store = &ps->store;
+	handle = store->AddPoint(this, _x, _y);
+	cmd_main = cmd;
+	cmd_next = NULL;
+	type = t;
+	num = n;
+}
+
+Point::~Point()
+{
+	store->RemovePoint(handle);
+}
+
+wxPoint Point::ToWxPoint(bool useorigin)
+{
+	if (useorigin)
+		return pointsys->ToWxPoint(x(), y());
+	else
+		return *(new wxPoint(x() * (int) pointsys->scale, y() * (int) pointsys->scale));
+}
+
+bool Point::CheckWxPoint(wxPoint wxpoint)
+{
+	int cx, cy;
+	pointsys->FromWxPoint(wxpoint, cx, cy);
+	return (x() == cx && y() == cy);
+}
+
+
+
+// ----------------------------------------------------------------------------
+// DrawCmd
+// ----------------------------------------------------------------------------
+
+DrawCmd::DrawCmd(int x, int y, PointSystem *ps, DrawCmd *pv) : controlpoints(PointList::allocator_type(&ps->store.pool))
+{
+	// the new handle starts out with its ASS text out of date
+	store = &ps->store;
+	handle = store->AddCmd(this);
+	m_point = new (ps) Point(x, y, ps, MP, this);
+	m_point->cmd_main = this;
+	prev = pv;
+	dobreak = false;
+	invisible = false;
+}
+
+DrawCmd::~DrawCmd()
+{
+	if (m_point)
+		delete m_point;
+	for (PointList::iterator iter_cpoint = controlpoints.begin(); iter_cpoint != controlpoints.end(); iter_cpoint++)
+		delete (*iter_cpoint);
+	store->RemoveCmd(handle);
+}
+
+void DrawCmd::AppendCachedASS(ASSBuffer& out)
+{
+	if (IsASSDirty())
+	{
+		asscache.Clear();
+		AppendASS(asscache);
+		SetASSDirty(false);
+	}
+	out.Append(asscache);
+}
+
+
+
+// ----------------------------------------------------------------------------
+// DrawCmd_B
+// ----------------------------------------------------------------------------
+
+DrawCmd_B::DrawCmd_B(int x, int y, int x1, int y1, int x2, int y2, PointSystem *ps, DrawCmd *prev) : DrawCmd(x, y, ps, prev)
+{
+	type = B;
+	controlpoints.push_back(new (ps) Point(x1, y1, ps, CP, this, 1));
+	controlpoints.push_back(new (ps) Point(x2, y2, ps, CP, this, 2));
+	initialized = true;
+	C1Cont = false;
+}
+
+DrawCmd_B::DrawCmd_B(int x, int y, PointSystem *ps, DrawCmd *prev) : DrawCmd(x, y, ps, prev)
+{
+	type = B;
+	initialized = false;
+	C1Cont = false;
+}
+
+void DrawCmd_B::Init()
+{
+	// Ignore if this is already initted
+	if (initialized)
+		return;
+
+	wxPoint wx0 = prev->m_point->ToWxPoint();
+	wxPoint wx1 = m_point->ToWxPoint();
+	int xdiff = (wx1.x - wx0.x) / 3;
+	int ydiff = (wx1.y - wx0.y) / 3;
+	int xg, yg;
+
+	// first control
+	m_point->pointsys->FromWxPoint(wx0.x + xdiff, wx0.y + ydiff, xg, yg);
+	controlpoints.push_back(new (m_point->pointsys) Point(xg, yg, m_point->pointsys, CP, this, 1));
+
+	// second control
+	m_point->pointsys->FromWxPoint(wx1.x - xdiff, wx1.y - ydiff, xg, yg);
+	controlpoints.push_back(new (m_point->pointsys) Point(xg, yg, m_point->pointsys, CP, this, 2));
+
+	initialized = true;
+	SetASSDirty();
+	SetGeometryDirty();
+}
+
+void DrawCmd_B::AppendASS(ASSBuffer& out)
+{
+	out.Append('b');
+	if (initialized) {
+		PointList::iterator iterate = controlpoints.begin();
+		Point* c1 = (*iterate++);
+		Point* c2 = (*iterate);
+		out.AppendXY(c1->x(), c1->y());
+		out.AppendXY(c2->x(), c2->y());
+	}
+	else
+		out.Append(" ? ? ? ?", 8);
+	out.AppendXY(m_point->x(), m_point->y());
+}
+
+
+
+// ----------------------------------------------------------------------------
+// DrawCmd_S
+// ----------------------------------------------------------------------------
+
+DrawCmd_S::DrawCmd_S(int x, int y, PointSystem *ps, DrawCmd *prev) : DrawCmd(x, y, ps, prev)
+{
+	type = S;
+	initialized = false;
+	closed = false;
+	splinestep = 0;
+}
+
+DrawCmd_S::DrawCmd_S(int x, int y, std::vector<int> vals, PointSystem *ps, DrawCmd *prev) : DrawCmd(x, y, ps, prev)
+{
+	type = S;
+	splinestep = 0;
+	std::vector<int>::iterator it = vals.begin();
+	unsigned n = 0;
+	while (it != vals.end())
+	{
+		int ix = *it; it++;
+		int iy = *it; it++;
+		n++;
+		controlpoints.push_back(new (ps) Point(ix, iy, ps, CP, this, n));
+	}
+
+	initialized = true;
+	closed = false;
+}
+
+void DrawCmd_S::Init()
+{
+	// Ignore if this is already initted
+	if (initialized)
+		return;
+
+	 wxPoint wx0 = prev->m_point->ToWxPoint();
+	 wxPoint wx1 = m_point->ToWxPoint();
+	 int xdiff = (wx1.x - wx0.x) / 3;
+	 int ydiff = (wx1.y - wx0.y) / 3;
+	 int xg, yg;
+
+	 // first control
+	 m_point->pointsys->FromWxPoint(wx0.x + xdiff, wx0.y + ydiff, xg, yg);
+	 controlpoints.push_back(new (m_point->pointsys) Point(xg, yg, m_point->pointsys, CP, this, 1));
+
+	 // second control
+	 m_point->pointsys->FromWxPoint(wx1.x - xdiff, wx1.y - ydiff, xg, yg);
+	 controlpoints.push_back(new (m_point->pointsys) Point(xg, yg, m_point->pointsys, CP, this, 2));
+
+	 initialized = true;
+	 SetASSDirty();
+	 SetGeometryDirty();
+}
+
+void DrawCmd_S::AppendASS(ASSBuffer& out)
+{
+	PointList::iterator iterate = controlpoints.begin();
+	out.Append('s');
+	for (; iterate != controlpoints.end(); iterate++)
+	{
+		if (initialized)
+			out.AppendXY((*iterate)->x(), (*iterate)->y());
+		else
+			out.Append(" ? ?", 4);
+	}
+	out.AppendXY(m_point->x(), m_point->y());
+	if (closed)
+		out.Append(" c", 2);
+}
+
+
+
+// ----------------------------------------------------------------------------
+// ASSDrawShape
+// ----------------------------------------------------------------------------
+
+ASSDrawShape::ASSDrawShape()
+{
+	pointsys = new PointSystem(1, 0, 0);
+	cmdschanged = true;
+	assrevision = 0;
+	drawcmdset = _T("m n l b s p c _"); //the spaces and underscore are in there for a reason, guess?
+	ResetEngine();
+}
+
+ASSDrawShape::~ASSDrawShape()
+{
+	ResetEngine(false);
+	if (parsestate.s_command != NULL)
+		delete parsestate.s_command;
+	delete pointsys;
+}
+
+// parse ASS draw commands; returns the number of parsed commands
+int ASSDrawShape::ParseASS(const wxString& str)
+{
+	BeginParseASS();
+	FeedParseASS(str);
+	return FinishParseASS();
+}
+
+// this is a single pass over the characters of the input: tokens are classified while
+// they are being read and the commands are built directly from them, without
+// copying/lowercasing the string or splitting it into substrings first
+void ASSDrawShape::BeginParseASS()
+{
+	ResetEngine(false);
+
+	// an S command left over from an unfinished parse
+	if (parsestate.s_command != NULL)
+		delete parsestate.s_command;
+	parsestate = ParseState();
+
+	for (wxString::const_iterator it = drawcmdset.begin(); it != drawcmdset.end(); ++it)
+	{
+		wxUniChar::value_type c = (*it).GetValue();
+		if (c < 128 && c != ' ')
+			parsestate.iscmd[c] = true;
+	}
+}
+
+// bytes >= 128 (e.g. from UTF-8 sequences) can't be part of a valid token, same as
+// non-ASCII characters in a wxString, so the input encoding doesn't matter
+void ASSDrawShape::FeedParseASS(const char *data, size_t len)
+{
+	for (const char *end = data + len; data != end; data++)
+		ParseASSChar((unsigned char) *data);
+}
+
+void ASSDrawShape::FeedParseASS(const wxString& str)
+{
+	for (wxString::const_iterator it = str.begin(); it != str.end(); ++it)
+		ParseASSChar((*it).GetValue());
+}
+
+int ASSDrawShape::FinishParseASS()
+{
+	// end the last token
+	ParseASSChar(' ');
+
+	// two dummy commands to flush the last command and any pending N/S
+	ParseASSCommand('_');
+	ParseASSCommand('_');
+
+	parsestate = ParseState();
+	return (int) cmds.size();
+}
+
+inline void ASSDrawShape::ParseASSChar(unsigned int c)
+{
+	ParseState& ps = parsestate;
+
+	// tabs and line breaks are simply dropped, they don't separate tokens
+	if (c == '\t' || c == '\r' || c == '\n')
+		return;
+
+	if (c == ' ')
+	{
+		if (ps.token == ParseState::TOKEN_CMD)
+			ParseASSCommand(ps.tokencmd);
+		else if (ps.token == ParseState::TOKEN_NUMBER)
+			ParseASSValue((int) (ps.negative? 0UL - ps.number:ps.number));
+		ps.token = ParseState::TOKEN_NONE;
+		return;
+	}
+
+	if (c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+	bool digit = c >= '0' && c <= '9';
+
+	switch (ps.token)
+	{
+		case ParseState::TOKEN_NONE:
+		case ParseState::TOKEN_SPACE:
+			ps.negative = false;
+			ps.number = 0;
+			// ToLong skips leading whitespace, but such a token can't be a command
+			if (c == '\v' || c == '\f')
+				ps.token = ParseState::TOKEN_SPACE;
+			else if (c < 128 && ps.iscmd[c] && ps.token == ParseState::TOKEN_NONE)
+				ps.token = ParseState::TOKEN_CMD, ps.tokencmd = (char) c;
+			else if (digit)
+				ps.token = ParseState::TOKEN_NUMBER, ps.number = c - '0';
+			else if (c == '-' || c == '+')
+				ps.token = ParseState::TOKEN_SIGN, ps.negative = c == '-';
+			else
+				ps.token = ParseState::TOKEN_INVALID;
+			break;
+		case ParseState::TOKEN_SIGN:
+		case ParseState::TOKEN_NUMBER:
+		{
+			// same as wxString::ToLong: the whole token must be a number that fits in a long
+			unsigned long limit = ps.negative? (unsigned long) LONG_MAX + 1:LONG_MAX;
+			if (digit && ps.number <= (limit - (c - '0')) / 10)
+				ps.token = ParseState::TOKEN_NUMBER, ps.number = ps.number * 10 + (c - '0');
+			else
+				ps.token = ParseState::TOKEN_INVALID;
+			break;
+		}
+		case ParseState::TOKEN_CMD:
+			// commands are single letters
+			ps.token = ParseState::TOKEN_INVALID;
+			break;
+		case ParseState::TOKEN_INVALID:
+			break;
+	}
+}
+
+// a new command token finishes the command collecting values so far
+void ASSDrawShape::ParseASSCommand(char cmd)
+{
+	ProcessParsedValues();
+	parsestate.val.clear();
+	parsestate.currcmd = cmd;
+}
+
+void ASSDrawShape::ParseASSValue(int value)
+{
+	parsestate.val.push_back(value);
+
+	// L and B are greedy, so each of them can be built as soon as its values are
+	// complete; this keeps val small no matter how long the run of values is
+	if ((parsestate.currcmd == 'l' && parsestate.val.size() == 2) || (parsestate.currcmd == 'b' && parsestate.val.size() == 6))
+	{
+		ProcessParsedValues();
+		parsestate.val.clear();
+	}
+}
+
+void ASSDrawShape::ProcessParsedValues()
+{
+	ParseState& ps = parsestate;
+	std::vector<int>& val = ps.val;
+	size_t at = 0; // values before this index have been used up by greedy L/B
+	bool done;
+
+	do {
+		done = true;
+
+		// N
+		if (ps.currcmd == 'n' && val.size() - at >= 2)
+		{
+			ps.tmp_n_pnt.x = val[at], ps.tmp_n_pnt.y = val[at + 1];
+			ps.n_collected = true;
+		}
+		else if (ps.n_collected)
+		{
+			AppendCmd(NewCmd(L, ps.tmp_n_pnt.x, ps.tmp_n_pnt.y));
+			ps.n_collected = false;
+		}
+
+		if (ps.s_command != NULL)
+		{
+			bool ends = true;
+			if (ps.currcmd == 'p' && val.size() - at >= 2)
+			{
+				DrawCmd_S *s_command = ps.s_command;
+				s_command->m_point->type = CP;
+				s_command->m_point->num = s_command->controlpoints.size() + 1;
+				s_command->controlpoints.push_back(s_command->m_point);
+				s_command->m_point = new (pointsys) Point(val[at], val[at + 1], pointsys, MP, s_command);
+				ends = false;
+			}
+			else if (ps.currcmd == 'c')
+				ps.s_command->closed = true;
+
+			if (ends)
+			{
+				AppendCmd(ps.s_command);
+				ps.s_command = NULL;
+			}
+		}
+
+		// M
+		if (ps.currcmd == 'm' && val.size() - at >= 2)
+			AppendCmd(NewCmd(M, val[at], val[at + 1]));
+
+		// L
+		if (ps.currcmd == 'l' && val.size() - at >= 2)
+		{
+			AppendCmd(NewCmd(L, val[at], val[at + 1]));
+			at += 2;
+			// L is greedy
+			if (val.size() - at >= 2)
+				done = false;
+		}
+
+		// B
+		if (ps.currcmd == 'b' && val.size() - at >= 6)
+		{
+			AppendCmd(new (pointsys) DrawCmd_B(val[at + 4], val[at + 5], val[at], val[at + 1], val[at + 2], val[at + 3], pointsys, LastCmd()));
+			at += 6;
+			// so is B
+			if (val.size() - at >= 6)
+				done = false;
+		}
+
+		// S
+		if (ps.currcmd == 's' && val.size() - at >= 6)
+		{
+			int num = ((val.size() - at) / 2) * 2;
+			std::vector<int> val2(val.begin() + at, val.begin() + at + num - 2);
+			ps.s_command = new (pointsys) DrawCmd_S(val[at + num - 2], val[at + num - 1], val2, pointsys, LastCmd());
+		}
+		// more to come later
+	} while (!done);
+}
+
+// generate ASS draw commands
+wxString ASSDrawShape::GenerateASS()
+{
+	if (!cmdschanged && !pointsys->store.AnyASSDirty())
+		return assoutput;
+
+	// only the commands that changed are formatted again, the rest is copied from their cache;
+	// assbuf keeps its capacity between calls, so this usually doesn't allocate either
+	assbuf.Clear();
+	assbuf.Reserve(cmds.size() * 16);
+	for (DrawCmdList::iterator iterate = cmds.begin(); iterate != cmds.end(); iterate++)
+	{
+		(*iterate)->AppendCachedASS(assbuf);
+		assbuf.Append(' ');
+	}
+	wxString output = assbuf.ToWxString();
+	cmdschanged = false;
+	// changes that cancel out (a point dragged and back) leave the revision as it was
+	if (output != assoutput)
+	{
+		assoutput = output;
+		assrevision++;
+	}
+	return assoutput;
+}
+
+// Binary format: the 4 bytes 'A' 'D' 'b' 1, then for every command an opcode byte
+//   bits 0-2: CMDTYPE
+//   bit 3:    C1Cont for B, closed for S
+//   bit 4:    B or S whose control points haven't been generated yet (Init not called)
+// followed, for S only, by the number of control points as a varint, then by all points of
+// the command in ASS order (control points, then m_point), each as the difference of x and
+// y to the previous point, zig-zag encoded (small negative numbers stay small) into varints
+// of 7 bits per byte, low bits first, the high bit set on all but the last byte
+
+static const char BINARY_HEADER[4] = { 'A', 'D', 'b', 1 };
+enum { BINARY_TYPE = 0x07, BINARY_FLAG = 0x08, BINARY_UNINIT = 0x10 };
+
+static inline void AppendVarint(std::string& out, unsigned int value)
+{
+	while (value >= 0x80)
+	{
+		out += (char) (value | 0x80);
+		value >>= 7;
+	}
+	out += (char) value;
+}
+
+static inline bool ReadVarint(const unsigned char *&data, const unsigned char *end, unsigned int& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7)
+	{
+		if (data == end)
+			return false;
+		unsigned int b = *data++;
+		value |= (b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// the differences are taken in unsigned arithmetic, so they wrap around instead of
+// overflowing and any pair of ints round-trips
+static inline void AppendBinaryPoint(std::string& out, Point *point, int& lastx, int& lasty)
+{
+	unsigned int dx = (unsigned int) point->x() - (unsigned int) lastx;
+	unsigned int dy = (unsigned int) point->y() - (unsigned int) lasty;
+	AppendVarint(out, (dx << 1) ^ (0u - (dx >> 31)));
+	AppendVarint(out, (dy << 1) ^ (0u - (dy >> 31)));
+	lastx = point->x();
+	lasty = point->y();
+}
+
+static inline bool ReadBinaryPoint(const unsigned char *&data, const unsigned char *end, int& x, int& y)
+{
+	unsigned int zx, zy;
+	if (!ReadVarint(data, end, zx) || !ReadVarint(data, end, zy))
+		return false;
+	x = (int) ((unsigned int) x + ((zx >> 1) ^ (0u - (zx & 1))));
+	y = (int) ((unsigned int) y + ((zy >> 1) ^ (0u - (zy & 1))));
+	return true;
+}
+
+// generate the binary encoding of the commands
+void ASSDrawShape::GenerateBinary(std::string& out)
+{
+	out.clear();
+	out.reserve(cmds.size() * 4 + sizeof(BINARY_HEADER));
+	out.append(BINARY_HEADER, sizeof(BINARY_HEADER));
+
+	int lastx = 0, lasty = 0;
+	for (DrawCmdList::iterator iterate = cmds.begin(); iterate != cmds.end(); iterate++)
+	{
+		DrawCmd *cmd = *iterate;
+		unsigned int op = cmd->type;
+		if (cmd->type == B)
+		{
+			if (static_cast<DrawCmd_B*>(cmd)->C1Cont)
+				op |= BINARY_FLAG;
+			if (!cmd->initialized)
+				op |= BINARY_UNINIT;
+		}
+		else if (cmd->type == S)
+		{
+			if (static_cast<DrawCmd_S*>(cmd)->closed)
+				op |= BINARY_FLAG;
+			if (!cmd->initialized)
+				op |= BINARY_UNINIT;
+		}
+		out += (char) op;
+
+		if (cmd->type == S)
+			AppendVarint(out, cmd->controlpoints.size());
+		for (PointList::iterator it = cmd->controlpoints.begin(); it != cmd->controlpoints.end(); it++)
+			AppendBinaryPoint(out, *it, lastx, lasty);
+		AppendBinaryPoint(out, cmd->m_point, lastx, lasty);
+	}
+}
+
+// parse the binary encoding of commands; returns the number of parsed commands
+int ASSDrawShape::ParseBinary(const char *data, size_t len)
+{
+	ResetEngine(false);
+	if (len < sizeof(BINARY_HEADER) || memcmp(data, BINARY_HEADER, sizeof(BINARY_HEADER)) != 0)
+		return -1;
+
+	const unsigned char *p = (const unsigned char *) data + sizeof(BINARY_HEADER);
+	const unsigned char *end = (const unsigned char *) data + len;
+	// every command takes at least 3 bytes and every point at least 2, so this is all the
+	// store can need
+	pointsys->store.Reserve((unsigned int) (len / 2), (unsigned int) (len / 3));
+
+	// the commands are linked to each other here as they're made, instead of one AppendCmd
+	// (and ConnectSubsequentCmds, which would clear C1Cont in the canvas) at a time
+	int x = 0, y = 0;
+	std::vector<int> ctrl;
+	DrawCmd *last = NULL;
+	while (p != end)
+	{
+		unsigned int op = *p++;
+		CMDTYPE type = (CMDTYPE) (op & BINARY_TYPE);
+		bool uninit = (op & BINARY_UNINIT) != 0;
+
+		unsigned int nctrl = 0;
+		if (type == B)
+			nctrl = uninit? 0:2;
+		else if (type == S)
+		{
+			// every point takes at least 2 bytes, which also keeps garbage from allocating a lot
+			if (!ReadVarint(p, end, nctrl) || nctrl > (unsigned int) (end - p) / 2 || (uninit && nctrl > 0))
+			{
+				ResetEngine(false);
+				return -1;
+			}
+		}
+		else if (type != M && type != L)
+		{
+			ResetEngine(false);
+			return -1;
+		}
+
+		ctrl.resize(nctrl * 2);
+		bool ok = true;
+		for (unsigned int i = 0; ok && i < nctrl; i++)
+		{
+			ok = ReadBinaryPoint(p, end, x, y);
+			ctrl[i * 2] = x;
+			ctrl[i * 2 + 1] = y;
+		}
+		if (!ok || !ReadBinaryPoint(p, end, x, y))
+		{
+			ResetEngine(false);
+			return -1;
+		}
+
+		// the first command is always an M, as AppendCmd would make it
+		if (last == NULL)
+			type = M;
+
+		DrawCmd *cmd;
+		if (type == B)
+		{
+			DrawCmd_B *b;
+			if (uninit)
+				b = new (pointsys) DrawCmd_B(x, y, pointsys, last);
+			else
+				b = new (pointsys) DrawCmd_B(x, y, ctrl[0], ctrl[1], ctrl[2], ctrl[3], pointsys, last);
+			b->C1Cont = (op & BINARY_FLAG) != 0;
+			cmd = b;
+		}
+		else if (type == S)
+		{
+			DrawCmd_S *sc = new (pointsys) DrawCmd_S(x, y, pointsys, last);
+			for (unsigned int i = 0; i < nctrl; i++)
+				sc->controlpoints.push_back(new (pointsys) Point(ctrl[i * 2], ctrl[i * 2 + 1], pointsys, CP, sc, i + 1));
+			sc->initialized = !uninit;
+			sc->closed = (op & BINARY_FLAG) != 0;
+			cmd = sc;
+		}
+		else if (type == M)
+			cmd = new (pointsys) DrawCmd_M(x, y, pointsys, last);
+		else
+			cmd = new (pointsys) DrawCmd_L(x, y, pointsys, last);
+
+		if (last)
+			last->m_point->cmd_next = cmd;
+		cmds.push_back(cmd);
+		cmd->SetListPos(--cmds.end());
+		last = cmd;
+	}
+	CmdsChanged();
+
+	return (int) cmds.size();
+}
+
+// reset; delete all points and add a new M(0,0) if addM == true
+void ASSDrawShape::ResetEngine(bool addM)
+{
+	for (DrawCmdList::iterator iterate = cmds.begin(); iterate != cmds.end(); iterate++)
+		delete (*iterate);
+	cmds.clear();
+	CmdsChanged();
+	if (addM)
+		AppendCmd(NewCmd(M, 0, 0));
+}
+
+DrawCmd* ASSDrawShape::AppendCmd(DrawCmd* cmd)
+{
+	if (cmd == NULL)
+		return NULL;
+
+	// set dependency of this command on the m_point of the last command
+	if (!cmds.empty())
+		ConnectSubsequentCmds(cmds.back(), cmd);
+	else
+	{
+		// since this is the first command, if it's not an M make it into one
+		if (cmd->type != M)
+		{
+			DrawCmd *m = NewCmd(M, cmd->m_point->x(), cmd->m_point->y());
+			delete cmd;
+			cmd = m;
+		}
+		ConnectSubsequentCmds(NULL, cmd);
+	}
+
+	cmds.push_back(cmd);
+	cmd->SetListPos(--cmds.end());
+	CmdsChanged();
+	return cmd;
+}
+
+// create draw command of type 'type' and m_point (x, y), insert to the list after the _cmd and return it
+DrawCmd* ASSDrawShape::InsertCmd(CMDTYPE type, int x, int y, DrawCmd* _cmd)
+{
+	// prepare the new DrawCmd
+	DrawCmd* c = NewCmd(type, x, y);
+
+	// use a variation of this method
+	InsertCmd(c, _cmd);
+
+	return NULL;
+}
+
+// insert draw command cmd after _cmd
+void ASSDrawShape::InsertCmd(DrawCmd* cmd, DrawCmd* _cmd)
+{
+	if (_cmd == NULL || !_cmd->InList())
+		AppendCmd(cmd);
+	else
+	{
+		DrawCmdList::iterator iterate = _cmd->listpos;
+		iterate++;
+		if (iterate != cmds.end())
+			ConnectSubsequentCmds(cmd, (*iterate));
+		cmd->SetListPos(cmds.insert(iterate, cmd));
+		CmdsChanged();
+		ConnectSubsequentCmds(_cmd, cmd);
+	}
+}
+
+DrawCmd* ASSDrawShape::NewCmd(CMDTYPE type, int x, int y)
+{
+	DrawCmd* c = NULL;
+
+	switch (type)
+	{
+		case M:
+			c = new (pointsys) DrawCmd_M(x, y, pointsys, LastCmd());
+			break;
+		case L:
+			c = new (pointsys) DrawCmd_L(x, y, pointsys, LastCmd());
+			break;
+		case B:
+			c = new (pointsys) DrawCmd_B(x, y, pointsys, LastCmd());
+			break;
+		case S:
+			c = new (pointsys) DrawCmd_S(x, y, pointsys, LastCmd());
+			break;
+	}
+	return c;
+}
+
+// returns the last command in the list
+DrawCmd* ASSDrawShape::LastCmd()
+{
+	if (cmds.empty())
+		return NULL;
+	else
+		return cmds.back();
+}
+
+// move all points by relative amount of x, y coordinates
+void ASSDrawShape::MovePoints(int x, int y)
+{
+	if (x == 0 && y == 0)
+		return;
+
+	DrawStore& store = pointsys->store;
+	for (unsigned int h = 0, n = store.PointHandles(); h < n; h++)
+	{
+		if (store.PointInList(h))
+		{
+			store.xy[h * 2] += x;
+			store.xy[h * 2 + 1] += y;
+		}
+	}
+	store.SetAllDirty();
+}
+
+// transform all points using the calculation:
+//   | (m11)  (m12) | x | (x - mx) | + | nx |
+//   | (m21)  (m22) |   | (y - my) |   | ny |
+void ASSDrawShape::Transform(float m11, float m12, float m21, float m22, float mx, float my, float nx, float ny)
+{
+	DrawStore& store = pointsys->store;
+	float x, y;
+	for (unsigned int h = 0, n = store.PointHandles(); h < n; h++)
+	{
+		if (store.PointInList(h))
+		{
+			x = ((float) store.xy[h * 2]) - mx;
+			y = ((float) store.xy[h * 2 + 1]) - my;
+			store.xy[h * 2] = (int) (x * m11 + y * m12 + nx);
+			store.xy[h * 2 + 1] = (int) (x * m21 + y * m22 + ny);
+		}
+	}
+	store.SetAllDirty();
+}
+
+int ASSDrawShape::SelectPointsWithin(PointSet& selection, int lx, int rx, int ty, int by, SELECTMODE smode)
+{
+	DrawStore& store = pointsys->store;
+	for (unsigned int h = 0, n = store.PointHandles(); h < n; h++)
+	{
+		unsigned char& flags = store.pointflags[h];
+		if (!store.PointInList(h))
+			continue;
+
+		wxPoint wx = pointsys->ToWxPoint(store.xy[h * 2], store.xy[h * 2 + 1]);
+
+		bool selected = (flags & DrawStore::POINT_SELECTED) != 0;
+		if (wx.x >= lx && wx.x <= rx && wx.y >= ty && wx.y <= by)
+			selected = (smode != DEL);
+		else
+			selected &= (smode != NEW);
+
+		if (selected)
+		{
+			flags |= DrawStore::POINT_SELECTED;
+			selection.insert(store.points[h]);
+		}
+		else
+		{
+			flags &= ~DrawStore::POINT_SELECTED;
+			selection.erase(store.points[h]);
+		}
+	}
+
+	return selection.size();
+}
+
+// returns some DrawCmd if its m_point = (x, y)
+DrawCmd* ASSDrawShape::PointAt(int x, int y)
+{
+	// find the point in the store; only if there's more than one the order of the
+	// commands matters, then it's the last one, same as with the list
+	DrawStore& store = pointsys->store;
+	DrawCmd* c = NULL;
+	int found = 0;
+	for (unsigned int h = 0, n = store.PointHandles(); h < n; h++)
+	{
+		if (store.xy[h * 2] == x && store.xy[h * 2 + 1] == y && store.PointInList(h) && store.points[h]->type == MP)
+		{
+			c = store.points[h]->cmd_main;
+			found++;
+		}
+	}
+	if (found <= 1)
+		return c;
+
+	DrawCmdList::iterator iterate = cmds.begin();
+	for (; iterate != cmds.end(); iterate++)
+	{
+		if ((*iterate)->m_point->IsAt(x, y))
+			c = (*iterate);
+	}
+
+	return c;
+}
+
+// returns some DrawCmd if one of its control point = (x, y) also set &point to refer to that control point
+DrawCmd* ASSDrawShape::ControlAt(int x, int y, Point* &point)
+{
+	DrawStore& store = pointsys->store;
+	DrawCmd* c = NULL;
+	point = NULL;
+	int found = 0;
+	for (unsigned int h = 0, n = store.PointHandles(); h < n; h++)
+	{
+		if (store.xy[h * 2] == x && store.xy[h * 2 + 1] == y && store.PointInList(h) && store.points[h]->type == CP)
+		{
+			point = store.points[h];
+			c = point->cmd_main;
+			found++;
+		}
+	}
+	if (found <= 1)
+		return c;
+
+	DrawCmdList::iterator cmd_iterator = cmds.begin();
+	PointList::iterator pnt_iterator;
+	PointList::iterator end;
+
+	for (; cmd_iterator != cmds.end(); cmd_iterator++)
+	{
+		pnt_iterator = (*cmd_iterator)->controlpoints.begin();
+		end = (*cmd_iterator)->controlpoints.end();
+		for (; pnt_iterator != end; pnt_iterator++)
+		{
+			if ((*pnt_iterator)->IsAt(x, y))
+			{
+				c = (*cmd_iterator);
+				point = (*pnt_iterator);
+			}
+		}
+	}
+
+	return c;
+}
+
+// attempts to delete a commmand, returns true|false if successful|fail
+bool ASSDrawShape::DeleteCommand(DrawCmd* cmd)
+{
+	// can't delete the first command without deleting other commands first
+	if (!cmds.empty() && cmd == cmds.front() && cmds.size() > 1)
+		return false;
+
+	if (cmd != NULL && cmd->InList())
+	{
+		UnlinkCmd(cmd);
+		delete cmd;
+	}
+
+	return true;
+}
+
+int ASSDrawShape::DeleteCommands(const DrawCmdSet& todelete)
+{
+	size_t inlist = 0;
+	for (DrawCmdSet::const_iterator it = todelete.begin(); it != todelete.end(); it++)
+		if ((*it)->InList())
+			inlist++;
+	DrawCmd* keep = (inlist < cmds.size()? cmds.front():NULL);
+
+	int deleted = 0;
+	for (DrawCmdSet::const_iterator it = todelete.begin(); it != todelete.end(); it++)
+	{
+		DrawCmd* cmd = *it;
+		if (cmd == keep || !cmd->InList())
+			continue;
+		UnlinkCmd(cmd);
+		delete cmd;
+		deleted++;
+	}
+
+	return deleted;
+}
+
+void ASSDrawShape::UnlinkCmd(DrawCmd* cmd)
+{
+	DrawCmdList::iterator iterate = cmd->listpos;
+	DrawCmd* prv = NULL;
+	if (iterate != cmds.begin())
+	{
+		iterate--;
+		prv = *iterate;
+		iterate++;
+	}
+	iterate++;
+	DrawCmd* nxt = (iterate != cmds.end()? (*iterate) : NULL);
+	ConnectSubsequentCmds(prv, nxt);
+
+	cmds.erase(cmd->listpos);
+	cmd->ClearListPos();
+	CmdsChanged();
+}
+
+// set stuff to connect two drawing commands cmd1 and cmd2 such that cmd1 comes right before cmd2
+void ASSDrawShape::ConnectSubsequentCmds(DrawCmd* cmd1, DrawCmd* cmd2)
+{
+	if (cmd1 != NULL)
+		cmd1->m_point->cmd_next = cmd2;
+
+	if (cmd2 != NULL)
+		cmd2->prev = cmd1;
+}
+
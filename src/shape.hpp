@@ -0,0 +1,634 @@
+/*
+* Copyright (c) 2007, ai-chan
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the ASSDraw3 Team nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY AI-CHAN ``AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL AI-CHAN BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+///////////////////////////////////////////////////////////////////////////////
+// Name:        shape.hpp
+// Purpose:     header file for the ASSDraw drawing commands (GUI independent)
+// Author:      ai-chan
+// Created:     10/17/26
+// Copyright:   (c) ai-chan
+// Licence:     3-clause BSD
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stddef.h>
+#include <math.h>
+#include <list>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <wx/string.h>
+#include <wx/gdicmn.h>
+
+// Command type
+enum CMDTYPE
+{
+	M = 0,
+	N = 1,
+	L = 2,
+	B = 3,
+	S = 4,
+	P = 5,
+	C = 6
+};
+
+// how a selection changes the points already selected
+enum SELECTMODE { NEW, ADD, DEL };
+
+// Point type
+enum POINTTYPE
+{
+	MP, // main point
+	CP  // control point
+};
+
+class Point;
+class DrawCmd;
+class PointSystem;
+
+typedef std::list<DrawCmd*> DrawCmdList;
+typedef std::set<DrawCmd*> DrawCmdSet;
+
+// Memory for the Points and DrawCmds of a drawing: blocks are cut from big chunks and
+// recycled through a free list per size, and once all blocks are back (the drawing has
+// been reset) the chunks are cut again from the start, so parsing a drawing after a reset
+// doesn't take any memory from the system
+class DrawPool
+{
+public:
+	DrawPool();
+	~DrawPool();
+
+	void* Alloc(size_t size);
+	// return p, allocated with this size, to the pool it came from; with size 0 the
+	// block is only reused after the pool has been emptied
+	static void Free(void *p, size_t size);
+
+	// counts of what the pool has done, to measure it
+	struct Stats
+	{
+		Stats() : allocs(0), frees(0), chunks(0) { }
+
+		// blocks handed out and returned
+		unsigned long allocs, frees;
+		// chunks taken from the system
+		unsigned long chunks;
+	};
+	const Stats& GetStats() const { return stats; }
+	void ResetStats() { stats = Stats(); }
+
+private:
+	enum { GRANULARITY = 8, SIZECLASSES = 64, CHUNKSIZE = 64 * 1024 };
+
+	// in front of every block, so Free can find the pool (NULL if too big for the pool)
+	struct Header { DrawPool *pool; };
+	struct FreeBlock { FreeBlock *next; };
+
+	void Release(Header *block, size_t size);
+
+	std::vector<char*> chunks;
+	// the chunk blocks are being cut from and how much of it has been used
+	size_t chunk, used;
+	FreeBlock *freelist[SIZECLASSES];
+	// blocks handed out and not returned yet
+	unsigned long live;
+	Stats stats;
+
+	DrawPool(const DrawPool&);
+	DrawPool& operator=(const DrawPool&);
+};
+
+// Allocator for the containers kept inside Points and DrawCmds, so their nodes come from the
+// drawing's pool too; without a pool it's plain operator new
+template <class T>
+class DrawPoolAllocator
+{
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	template <class U> struct rebind { typedef DrawPoolAllocator<U> other; };
+
+	DrawPoolAllocator(DrawPool *p = NULL) : pool(p) { }
+	template <class U> DrawPoolAllocator(const DrawPoolAllocator<U>& other) : pool(other.pool) { }
+
+	pointer address(reference r) const { return &r; }
+	const_pointer address(const_reference r) const { return &r; }
+	size_type max_size() const { return size_t(-1) / sizeof(T); }
+	void construct(pointer p, const T& value) { new ((void *) p) T(value); }
+	void destroy(pointer p) { p->~T(); }
+
+	pointer allocate(size_type n, const void * = 0)
+	{
+		return (pointer) (pool? pool->Alloc(n * sizeof(T)):(::operator new)(n * sizeof(T)));
+	}
+	void deallocate(pointer p, size_type n)
+	{
+		if (pool)
+			DrawPool::Free(p, n * sizeof(T));
+		else
+			::operator delete(p);
+	}
+
+	bool operator==(const DrawPoolAllocator& other) const { return pool == other.pool; }
+	bool operator!=(const DrawPoolAllocator& other) const { return pool != other.pool; }
+
+	DrawPool *pool;
+};
+
+// Dense storage for the data of all points and commands of a drawing: every Point and
+// DrawCmd gets a handle (an index into these arrays) when it's created and keeps it for
+// its whole life, so loops that don't depend on the order of the commands (moving,
+// transforming, selecting, finding points) can run over the arrays instead of the lists
+class DrawStore
+{
+public:
+	DrawStore() : revision(0), livepoints(0), livecmds(0) { }
+
+	// flags of a point handle
+	enum { POINT_LIVE = 1, POINT_SELECTED = 2 };
+	// flags of a command handle
+	enum { CMD_LIVE = 1, CMD_ASSDIRTY = 2, CMD_INLIST = 4, CMD_GEOMDIRTY = 8 };
+
+	unsigned int AddPoint(Point *point, int x, int y);
+	void RemovePoint(unsigned int handle);
+	unsigned int AddCmd(DrawCmd *cmd);
+	void RemoveCmd(unsigned int handle);
+	// make room for this many points and commands in all
+	void Reserve(unsigned int npoints, unsigned int ncmds);
+
+	// number of handles, including the unused ones (whose flags are 0)
+	unsigned int PointHandles() const { return points.size(); }
+	unsigned int CmdHandles() const { return cmds.size(); }
+
+	// mark the ASS text and the geometry of every command out of date
+	void SetAllDirty();
+	// true if the ASS text of any command is out of date
+	bool AnyASSDirty() const;
+	// true if point handle h is live and belongs to a command that's in the list of its
+	// drawing; a command made with NewCmd has its points here before it's added
+	bool PointInList(unsigned int h) const;
+
+	// point handle h is at (xy[2 * h], xy[2 * h + 1])
+	std::vector<int> xy;
+	std::vector<unsigned char> pointflags;
+	std::vector<Point*> points;
+
+	std::vector<unsigned char> cmdflags;
+	std::vector<DrawCmd*> cmds;
+
+	// incremented whenever the geometry of the drawing may have changed (a command's points
+	// or the list of commands), so whatever is built from all of it can tell it's out of date
+	unsigned long revision;
+
+	// where the Points and DrawCmds themselves live
+	DrawPool pool;
+
+private:
+	// handles that can be reused
+	std::vector<unsigned int> freepoints, freecmds;
+	unsigned int livepoints, livecmds;
+};
+
+// A PointSystem is a centralized entity holding the parameters:
+// scale, originx and originy, all of which are needed by Point,
+// and the store where the points and commands keep their data
+class PointSystem
+{
+public:
+	PointSystem(double sc = 1.0, double origx = 0.0, double origy = 0.0) { Set(sc, origx, origy); }
+
+	// set scale, originx and originy;
+	void Set(double sc, double origx, double origy)
+	{
+		scale = sc;
+		originx = origx;
+		originy = origy;
+	}
+
+	wxRealPoint ToWxRealPoint(double x, double y) { return wxRealPoint(originx + x * scale, originy + y * scale); }
+
+	// given drawing command coordinates returns the wxPoint on the GUI
+	wxPoint ToWxPoint(double x, double y) { return wxPoint((int) (originx + x * scale), (int) (originy + y * scale)); }
+
+	// given wxPoint on the GUI returns the nearest drawing command coords
+	void FromWxPoint(int wxpx, int wxpy, int &x, int &y)
+	{
+		x = int(floor(((double) wxpx - originx) / scale + 0.5));
+		y = int(floor(((double) wxpy - originy) / scale + 0.5));
+	}
+
+	// given wxPoint on the GUI returns the nearest drawing command coords
+	void FromWxPoint(wxPoint wxp, int &x, int &y) { FromWxPoint(wxp.x, wxp.y, x, y); }
+
+	double scale, originx, originy;
+
+	DrawStore store;
+};
+
+// Output buffer for serializing drawing commands; the commands only ever produce
+// ASCII so they're appended as plain chars and converted to wxString once at the end
+class ASSBuffer
+{
+public:
+	void Clear() { buf.clear(); }
+	void Reserve(size_t n) { buf.reserve(n); }
+	size_t Length() const { return buf.size(); }
+
+	void Append(char c) { buf += c; }
+	void Append(const char *s, size_t len) { buf.append(s, len); }
+	void Append(const ASSBuffer& other) { buf.append(other.buf); }
+	// append the decimal representation of value (without printf)
+	void AppendInt(int value);
+	// append " x y"
+	void AppendXY(int x, int y) { Append(' '); AppendInt(x); Append(' '); AppendInt(y); }
+
+	wxString ToWxString() const { return wxString(buf.data(), wxConvUTF8, buf.size()); }
+
+private:
+	std::string buf;
+};
+
+// The point class
+// note: this actually refers to the x,y-coordinate in drawing commands, not the coordinate in the GUI
+class Point
+{
+public:
+	Point(int _x, int _y, PointSystem* ps, POINTTYPE t, DrawCmd* cmd, unsigned n = 0);
+	~Point();
+
+	// Points are allocated from the pool of their PointSystem: new (ps) Point(...)
+	static void* operator new(size_t size, PointSystem *ps) { return ps->store.pool.Alloc(size); }
+	static void operator delete(void *p, size_t size) { DrawPool::Free(p, size); }
+	static void operator delete(void *p, PointSystem *) { DrawPool::Free(p, 0); }
+
+	// getters
+	int x() { return store->xy[handle * 2]; }
+	int y() { return store->xy[handle * 2 + 1]; }
+
+	//set x and y; marks the ASS text and geometry of cmd_main as out of date
+	void setXY(int _x, int _y);
+
+	// simply returns true if px and py are the coordinate values
+	bool IsAt(int px, int py) { return (x() == px && y() == py); }
+
+	// convert this point to wxPoint using scale and originx, originy
+	wxPoint ToWxPoint() { return ToWxPoint(true); }
+
+	// convert this point to wxPoint using scale; also use originx and originy if useorigin = true
+	wxPoint ToWxPoint(bool useorigin);
+
+	// check if wxpoint is nearby this point
+	bool CheckWxPoint(wxPoint wxpoint);
+
+	POINTTYPE type;
+	PointSystem *pointsys;
+
+	// drawing commands that depend on this point
+	DrawCmd* cmd_main;
+	DrawCmd* cmd_next;
+	unsigned num;
+
+	bool IsSelected() { return (store->pointflags[handle] & DrawStore::POINT_SELECTED) != 0; }
+	void SetSelected(bool selected);
+
+private:
+	DrawStore *store;
+	unsigned int handle;
+
+	// the handle belongs to this Point only
+	Point(const Point&);
+	Point& operator=(const Point&);
+};
+
+typedef std::list<Point*, DrawPoolAllocator<Point*> > PointList;
+typedef std::set<Point*> PointSet;
+
+// The base class for all draw commands
+class DrawCmd
+{
+public:
+	DrawCmd(int x, int y, PointSystem *ps, DrawCmd *pv);
+	virtual ~DrawCmd();
+
+	// so are DrawCmds: new (ps) DrawCmd_L(...)
+	static void* operator new(size_t size, PointSystem *ps) { return ps->store.pool.Alloc(size); }
+	static void operator delete(void *p, size_t size) { DrawPool::Free(p, size); }
+	static void operator delete(void *p, PointSystem *) { DrawPool::Free(p, 0); }
+
+	// Init the draw command (for example to generate the control points)
+	virtual void Init() { initialized = true; }
+	// append the ASS representation of this command to out
+	virtual void AppendASS(ASSBuffer& out) { }
+	wxString ToString() { ASSBuffer out; AppendASS(out); return out.ToWxString(); }
+
+	// same as AppendASS but reuses the text from the last call unless the command has changed since
+	void AppendCachedASS(ASSBuffer& out);
+
+	CMDTYPE type;
+
+	// main point (almost every command has one) for B and S it's the last (destination) point
+	Point* m_point;
+
+	// other points than the main point, subclasses must populate this list even if they define new variables for other points
+	PointList controlpoints;
+
+	// Linked list feature
+	DrawCmd *prev;
+
+	// Must set to true if the next command should NOT utilize this command for the drawing
+	bool dobreak;
+
+	// Set to true if invisible m_point (not drawn)
+	bool invisible;
+
+	// true if this DrawCmd has been initialized with Init(), false otherwise (initialized means that the control points have been generated)
+	bool initialized;
+
+	// whether the ASS text in asscache is out of date; must be set by whatever changes the output of AppendASS
+	bool IsASSDirty() { return (store->cmdflags[handle] & DrawStore::CMD_ASSDIRTY) != 0; }
+	void SetASSDirty(bool dirty = true)
+	{
+		if (dirty)
+			store->cmdflags[handle] |= DrawStore::CMD_ASSDIRTY;
+		else
+			store->cmdflags[handle] &= ~DrawStore::CMD_ASSDIRTY;
+	}
+	ASSBuffer asscache;
+
+	// whether geometry cached from this command's points is out of date; set along with the
+	// ASS text, but cleared separately by whatever keeps such a cache
+	bool IsGeometryDirty() { return (store->cmdflags[handle] & DrawStore::CMD_GEOMDIRTY) != 0; }
+	void SetGeometryDirty(bool dirty = true)
+	{
+		if (dirty)
+		{
+			store->cmdflags[handle] |= DrawStore::CMD_GEOMDIRTY;
+			store->revision++;
+		}
+		else
+			store->cmdflags[handle] &= ~DrawStore::CMD_GEOMDIRTY;
+	}
+
+	// index of the command in the DrawStore arrays, for anything that wants to keep
+	// per-command data densely
+	unsigned int Handle() { return handle; }
+
+private:
+	DrawStore *store;
+	unsigned int handle;
+
+	// where the command is in the ASSDrawShape's list of commands, if it's in there at all,
+	// so it can be inserted after or removed without searching the list
+	friend class ASSDrawShape;
+	DrawCmdList::iterator listpos;
+	bool InList() { return (store->cmdflags[handle] & DrawStore::CMD_INLIST) != 0; }
+	void SetListPos(DrawCmdList::iterator pos)
+	{
+		listpos = pos;
+		store->cmdflags[handle] |= DrawStore::CMD_INLIST;
+	}
+	void ClearListPos() { store->cmdflags[handle] &= ~DrawStore::CMD_INLIST; }
+};
+
+inline void Point::setXY(int _x, int _y)
+{
+	int *xy = &store->xy[handle * 2];
+	if (xy[0] == _x && xy[1] == _y)
+		return;
+	xy[0] = _x;
+	xy[1] = _y;
+	if (cmd_main != NULL)
+	{
+		cmd_main->SetASSDirty();
+		cmd_main->SetGeometryDirty();
+	}
+}
+
+inline void Point::SetSelected(bool selected)
+{
+	if (selected)
+		store->pointflags[handle] |= DrawStore::POINT_SELECTED;
+	else
+		store->pointflags[handle] &= ~DrawStore::POINT_SELECTED;
+}
+
+// The M command
+class DrawCmd_M: public DrawCmd
+{
+public:
+	DrawCmd_M(int x, int y, PointSystem *ps, DrawCmd *prev) : DrawCmd(x, y, ps, prev) { type = M; }
+
+	void AppendASS(ASSBuffer& out) { out.Append('m'); out.AppendXY(m_point->x(), m_point->y()); }
+};
+
+// The L command
+class DrawCmd_L: public DrawCmd
+{
+public:
+	DrawCmd_L(int x, int y, PointSystem *ps, DrawCmd *prev) : DrawCmd(x, y, ps, prev) { type = L; }
+
+	void AppendASS(ASSBuffer& out) { out.Append('l'); out.AppendXY(m_point->x(), m_point->y()); }
+};
+
+// The B command
+class DrawCmd_B: public DrawCmd
+{
+public:
+	DrawCmd_B(int x, int y, int x1, int y1, int x2, int y2, PointSystem *ps, DrawCmd *prev);
+	DrawCmd_B(int x, int y, PointSystem *ps, DrawCmd *prev);
+
+	// Init this B command; generate controlpoints
+	void Init();
+	void AppendASS(ASSBuffer& out);
+
+	bool C1Cont;
+};
+
+// The S command
+class DrawCmd_S: public DrawCmd
+{
+public:
+	DrawCmd_S(int x, int y, PointSystem *ps, DrawCmd *prev);
+	DrawCmd_S(int x, int y, std::vector<int> vals, PointSystem *ps, DrawCmd *prev);
+
+	// Init this S command; generate controlpoints
+	void Init();
+
+	void AppendASS(ASSBuffer& out);
+
+	bool closed;
+
+	// the B-spline through the control points, flattened in drawing coordinates by the
+	// renderer (x, y pairs and the path command of each vertex) with parameter step
+	// splinestep; valid unless IsGeometryDirty()
+	std::vector<double> splinexy;
+	std::vector<unsigned char> splinecmds;
+	double splinestep;
+};
+
+// The drawing itself: the list of drawing commands and everything that can be done with it
+// without displaying it, so it can also be used where there's no GUI (e.g. assdraw_batch)
+class ASSDrawShape
+{
+public:
+	ASSDrawShape();
+	virtual ~ASSDrawShape();
+
+	virtual void SetDrawCmdSet(wxString set) { drawcmdset = set; }
+
+	virtual void ResetEngine(bool addM = true);
+
+	PointSystem* _PointSystem() { return pointsys; }
+
+	// what the pool of the points and commands has done since the last ResetAllocStats, for debugging
+	const DrawPool::Stats& AllocStats() { return pointsys->store.pool.GetStats(); }
+	void ResetAllocStats() { pointsys->store.pool.ResetStats(); }
+
+	virtual int ParseASS(const wxString& str);
+
+	// streaming version of ParseASS, for input that comes in pieces: call BeginParseASS, then
+	// FeedParseASS for each piece (pieces may split tokens anywhere), then FinishParseASS,
+	// which returns the number of parsed commands
+	void BeginParseASS();
+	void FeedParseASS(const char *data, size_t len);
+	void FeedParseASS(const wxString& str);
+	int FinishParseASS();
+	virtual wxString GenerateASS();
+	// incremented every time GenerateASS produces a different string than the last time it was called
+	unsigned long ASSRevision() { return assrevision; }
+
+	// compact binary encoding of the commands (format described in shape.cpp), about half
+	// the size of the ASS text, twice as fast to parse or more, and lossless, so it's used
+	// for snapshots
+	virtual void GenerateBinary(std::string& out);
+	// replace the commands with those encoded in data; returns the number of commands,
+	// or -1 (leaving no commands) if data isn't something GenerateBinary produced
+	virtual int ParseBinary(const char *data, size_t len);
+	int ParseBinary(const std::string& data) { return ParseBinary(data.data(), data.size()); }
+
+	// -------------------- adding new commands ----------------------------
+	virtual DrawCmd* AppendCmd(CMDTYPE type, int x, int y) { return AppendCmd(NewCmd(type, x, y)); }
+	virtual DrawCmd* AppendCmd(DrawCmd* cmd);
+
+	// create draw command of type 'type' and m_point (x, y), insert to the list after the _cmd and return it
+	virtual DrawCmd* InsertCmd(CMDTYPE type, int x, int y, DrawCmd* _cmd);
+	// insert draw command cmd after _cmd
+	virtual void InsertCmd(DrawCmd* cmd, DrawCmd* _cmd);
+
+	DrawCmd* NewCmd(CMDTYPE type, int x, int y);
+
+	// -------------------- read/modify commands ---------------------------
+	virtual DrawCmdList::iterator Iterator() { return cmds.begin(); }
+	virtual DrawCmdList::iterator IteratorEnd() { return cmds.end(); }
+
+	virtual DrawCmd* LastCmd();
+
+	// move all points by relative amount of x, y coordinates
+	virtual void MovePoints(int x, int y);
+
+	// transform all points using the calculation:
+	//   | (m11)  (m12) | x | (x - mx) | + | nx |
+	//   | (m21)  (m22) |   | (y - my) |   | ny |
+	virtual void Transform(float m11, float m12, float m21, float m22, float mx, float my, float nx, float ny);
+
+	// returns some DrawCmd if its m_point = (x, y)
+	virtual DrawCmd* PointAt(int x, int y);
+	// returns some DrawCmd if one of its control point = (x, y) also set &point to refer to that control point
+	virtual DrawCmd* ControlAt(int x, int y, Point* &point);
+
+	virtual bool DeleteCommand(DrawCmd* cmd);
+	// delete all commands in todelete in one go; the first command only if all of them
+	// are deleted; returns the number of deleted commands
+	virtual int DeleteCommands(const DrawCmdSet& todelete);
+
+	// update the selection state of the points with GUI coordinates within (lx, ty)-(rx, by) and
+	// their membership of selection; returns the number of points in selection
+	int SelectPointsWithin(PointSet& selection, int lx, int rx, int ty, int by, SELECTMODE smode = NEW);
+
+protected:
+	DrawCmdList cmds;
+	wxString drawcmdset;
+
+	// reused by GenerateASS
+	ASSBuffer assbuf;
+	// last output of GenerateASS, and whether cmds has been added to/removed from since
+	wxString assoutput;
+	bool cmdschanged;
+	unsigned long assrevision;
+	// the list of commands has been added to/removed from
+	void CmdsChanged() { cmdschanged = true; pointsys->store.revision++; }
+
+	PointSystem* pointsys;
+
+	// state of the single pass ParseASS tokenizer, kept between FeedParseASS calls
+	struct ParseState
+	{
+		ParseState() : token(TOKEN_NONE), tokencmd(0), negative(false), number(0), currcmd(0), n_collected(false), s_command(NULL)
+		{
+			for (int i = 0; i < 128; i++)
+				iscmd[i] = false;
+		}
+
+		// command letters we accept; anything else that's not a number is ignored
+		bool iscmd[128];
+
+		// the token being read
+		enum { TOKEN_NONE, TOKEN_SPACE, TOKEN_CMD, TOKEN_SIGN, TOKEN_NUMBER, TOKEN_INVALID } token;
+		char tokencmd;
+		bool negative;
+		unsigned long number;
+
+		// the command the collected values belong to (0 if none yet)
+		char currcmd;
+		std::vector<int> val;
+
+		// N and S commands stay pending until the next command decides how they end
+		bool n_collected;
+		wxPoint tmp_n_pnt;
+		DrawCmd_S *s_command;
+	};
+	ParseState parsestate;
+
+	// feed one character to the tokenizer
+	void ParseASSChar(unsigned int c);
+	// feed one command token / one number token to the parser
+	void ParseASSCommand(char cmd);
+	void ParseASSValue(int value);
+	// build the commands out of the values collected for parsestate.currcmd
+	void ProcessParsedValues();
+
+	// set stuff to connect two drawing commands cmd1 and cmd2 such that cmd1 comes right before cmd2
+	virtual void ConnectSubsequentCmds(DrawCmd* cmd1, DrawCmd* cmd2);
+	// take cmd out of the list of commands, connecting the commands before and after it
+	void UnlinkCmd(DrawCmd* cmd);
+};
@@ -5,6 +5,9 @@
 
 #include <wx/dcclient.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 namespace GUI {
 
 BEGIN_EVENT_TABLE(AGGWindow, wxWindow)
@@ -15,7 +18,7 @@ END_EVENT_TABLE()
 
 AGGWindow::AGGWindow(wxWindow* parent, wxWindowID id, const wxPoint& pos, const wxSize& size, long style):
 	wxWindow(parent, id, pos, size, style, wxT("AGGWindow")),
-	bitmap(NULL) {
+	bitmap(NULL), blitAll(false) {
 }
 
 void AGGWindow::init(const int width, const int height) {
@@ -67,7 +70,10 @@ void AGGWindow::attachAndDraw() {
 
 	rBuf.attach(pd, data.GetWidth(), data.GetHeight(), stride);
 
-	// Call the user code to actually draw.
+	// Call the user code to actually draw.  This redraws everything, so
+	// nothing is out of date anymore.
+	clipRect = wxRect(0, 0, data.GetWidth(), data.GetHeight());
+	dirty.clear();
 	draw();
 #else
 	PixelData::Iterator p(data);
@@ -124,6 +130,9 @@ void AGGWindow::onEraseBackground(wxEraseEvent& WXUNUSED(event)) {
 
 void AGGWindow::paint() {
 #ifndef __WINDOWS__
+	if (!bitmap || dirty.empty())
+		return;
+
 	wxClientDC dc(this);
 
 	PixelData data(*bitmap);
@@ -138,11 +147,142 @@ void AGGWindow::paint() {
 
 	rBuf.attach(pd, data.GetWidth(), data.GetHeight(), stride);
 
-	draw();
+	// only redraw and blit the regions that we changed
+	for (size_t i = 0; i < dirty.size(); i++) {
+		clipRect = dirty[i];
+		draw();
+	}
+	if (blitAll)
+		dc.Blit(0, 0, bitmap->GetWidth(), bitmap->GetHeight(), &memDC, 0, 0);
+	else
+		for (size_t i = 0; i < dirty.size(); i++)
+			dc.Blit(dirty[i].x, dirty[i].y, dirty[i].width, dirty[i].height, &memDC, dirty[i].x, dirty[i].y);
+	dirty.clear();
+	blitAll = false;
+#endif
+}
 
-	// fix this at some point to only blit regions that we changed
-	dc.Blit(0, 0, bitmap->GetWidth(), bitmap->GetHeight(), &memDC, 0, 0);
+void AGGWindow::invalidate(const wxRect& rect) {
+	wxRect r(rect);
+	if (bitmap)
+		r.Intersect(wxRect(0, 0, bitmap->GetWidth(), bitmap->GetHeight()));
+	mergeRect(dirty, r);
+}
+
+void AGGWindow::mergeRect(std::vector<wxRect>& rects, const wxRect& rect) {
+	if (rect.IsEmpty())
+		return;
+
+	// swallow whatever the new rectangle touches, until it touches nothing
+	wxRect r(rect);
+	for (size_t i = 0; i < rects.size(); ) {
+		if (rects[i].Intersects(r)) {
+			r.Union(rects[i]);
+			rects.erase(rects.begin() + i);
+			i = 0;
+		}
+		else
+			i++;
+	}
+
+	// too many rectangles: merge the new one with the one that grows the least
+	if (rects.size() >= MAX_DIRTY_RECTS) {
+		size_t best = 0;
+		double bestgrowth = 0.0;
+		for (size_t i = 0; i < rects.size(); i++) {
+			wxRect u(rects[i]);
+			u.Union(r);
+			double growth = (double) u.width * u.height - (double) rects[i].width * rects[i].height;
+			if (i == 0 || growth < bestgrowth) {
+				best = i;
+				bestgrowth = growth;
+			}
+		}
+		r.Union(rects[best]);
+		rects.erase(rects.begin() + best);
+		mergeRect(rects, r);
+		return;
+	}
+
+	rects.push_back(r);
+}
+
+void AGGWindow::invalidateAll() {
+	dirty.clear();
+	if (bitmap)
+		dirty.push_back(wxRect(0, 0, bitmap->GetWidth(), bitmap->GetHeight()));
+}
+
+void AGGWindow::scroll(int dx, int dy) {
+	if (!bitmap || (dx == 0 && dy == 0))
+		return;
+	const int width = bitmap->GetWidth(), height = bitmap->GetHeight();
+#ifdef __WINDOWS__
+	// the bitmap is drawn in onPaint() here, so parts of it may be waiting
+	// to be drawn and would be scrolled out of date; just draw it all
+	invalidateAll();
+	return;
+#else
+	if (dirty.size() == 1 && dirty[0] == wxRect(0, 0, width, height))
+		return;
+	if (abs(dx) >= width || abs(dy) >= height) {
+		invalidateAll();
+		return;
+	}
+	{
+		PixelData data(*bitmap);
+		assert(data);
+		assert(data.GetPixels().IsOk());
+		wxAlphaPixelFormat::ChannelType* pd = (wxAlphaPixelFormat::ChannelType*) &data.GetPixels().Data();
+		const int stride = data.GetRowStride();
+		if (stride < 0)
+			pd += (data.GetHeight() - 1) * stride;
+		rBuf.attach(pd, data.GetWidth(), data.GetHeight(), stride);
+		scrollBuffer(rBuf, dx, dy);
+	}
+
+	scrollRects(dirty, dx, dy, width, height);
+	blitAll = true;
 #endif
 }
 
+void AGGWindow::scrollRects(std::vector<wxRect>& rects, int dx, int dy, int width, int height) {
+	// what was out of date still is, where it has moved to
+	const wxRect all(0, 0, width, height);
+	std::vector<wxRect> moved;
+	moved.swap(rects);
+	for (size_t i = 0; i < moved.size(); i++) {
+		wxRect r(moved[i]);
+		r.Offset(dx, dy);
+		mergeRect(rects, r.Intersect(all));
+	}
+	// and so is what came into view
+	if (dx > 0)
+		mergeRect(rects, wxRect(0, 0, dx, height));
+	else if (dx < 0)
+		mergeRect(rects, wxRect(width + dx, 0, -dx, height));
+	if (dy > 0)
+		mergeRect(rects, wxRect(0, 0, width, dy));
+	else if (dy < 0)
+		mergeRect(rects, wxRect(0, height + dy, width, -dy));
+}
+
+void AGGWindow::scrollBuffer(agg::rendering_buffer& buf, int dx, int dy) {
+	const int width = buf.width(), height = buf.height();
+	if (abs(dx) >= width || abs(dy) >= height || (dx == 0 && dy == 0))
+		return;
+	const int bpp = PixelFormat::AGGType::pix_width;
+	const int len = (width - abs(dx)) * bpp;
+	// work away from the side the rows move to, so no row is overwritten before it's moved
+	for (int i = 0; i < height - abs(dy); i++) {
+		const int y = dy > 0? height - 1 - i : i;
+		agg::int8u* dst = buf.row_ptr(y);
+		agg::int8u* src = buf.row_ptr(y - dy);
+		if (dx > 0)
+			memmove(dst + dx * bpp, src, len);
+		else
+			memmove(dst, src - dx * bpp, len);
+	}
+}
+
 }
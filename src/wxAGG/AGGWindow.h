@@ -8,6 +8,8 @@
 #include <wx/window.h>
 #include <wx/dcmemory.h>
 
+#include <vector>
+
 #include "agg_rendering_buffer.h"
 
 namespace GUI {
@@ -26,6 +28,10 @@ public:
 	/// Clean up resources held
 	virtual ~AGGWindow();
 
+	/// Move the pixels of buf by dx, dy; the rows and columns they leave
+	/// behind keep their old contents.
+	static void scrollBuffer(agg::rendering_buffer& buf, int dx, int dy);
+
 protected:
 
 	/// The conversion between wxWidgets' pixel format and AGG's pixel format
@@ -49,15 +55,44 @@ protected:
 	/// Handle the erase-background event.
 	void onEraseBackground(wxEraseEvent& event);
 
-	/// Draw into the bitmap using AGG.
+	/// Draw into the bitmap using AGG.  Only the pixels inside clipRect need
+	/// to be drawn; the rest of the bitmap is still up to date.
 	virtual void draw() = 0;
+
+	/// Redraw the rectangles marked out of date and blit them onto the panel.
 	void paint();
 
+	/// Mark a rectangle of the bitmap as out of date, so the next paint()
+	/// redraws it.  Rectangles are merged so there are never more than
+	/// MAX_DIRTY_RECTS of them.
+	void invalidate(const wxRect& rect);
+
+	/// Mark the entire bitmap as out of date.
+	void invalidateAll();
+
+	/// Move the contents of the bitmap by dx, dy pixels, as for scrolling the
+	/// view, and mark what that uncovers as out of date.  The next paint()
+	/// then blits the entire bitmap, but only draws the out of date parts.
+	void scroll(int dx, int dy);
+
+	/// Move the out of date rectangles of a width x height buffer along with
+	/// scrollBuffer(), and add the parts of it the scrolling uncovers.
+	static void scrollRects(std::vector<wxRect>& rects, int dx, int dy, int width, int height);
+
+	/// Add rect to a list of rectangles the way invalidate() does.
+	static void mergeRect(std::vector<wxRect>& rects, const wxRect& rect);
+
+	enum { MAX_DIRTY_RECTS = 8 };
+
 	wxBitmap* bitmap;               ///< wxWidgets bitmap for AGG to draw into
 	wxMemoryDC memDC;               ///< Memory "device context" for drawing the bitmap
 
 	agg::rendering_buffer rBuf;     ///< AGG's rendering buffer, pointing into the bitmap
 
+	wxRect clipRect;                ///< The part of the bitmap draw() is asked to update
+	std::vector<wxRect> dirty;      ///< Out of date parts of the bitmap
+	bool blitAll;                   ///< The bitmap was scrolled since the last paint()
+
 	DECLARE_EVENT_TABLE()           /// Allocate wxWidgets storage for event handlers
 };
 }
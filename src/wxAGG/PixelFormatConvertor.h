@@ -31,6 +31,8 @@
 #include "agg_pixfmt_rgb.h"
 #include "agg_pixfmt_rgba.h"
 
+#include "PixelKernels.h"
+
 namespace {
 
     /// Given a particular combination of channel type, bits per pixel and 
@@ -110,7 +112,10 @@ namespace GUI {
                                               wxWidgetsPixelFormat::RED,
                                               wxWidgetsPixelFormat::GREEN,
                                               wxWidgetsPixelFormat::BLUE,
-                                              wxWidgetsPixelFormat::ALPHA>::format AGGType;
+                                              wxWidgetsPixelFormat::ALPHA>::format GenericAGGType;
+
+        /// The same pixels, with the fills, blends and copies of whole rows vectorized.
+        typedef KernelPixelFormat<GenericAGGType> AGGType;
     };
 }
 
@@ -0,0 +1,347 @@
+#include "PixelKernels.h"
+
+#include <string.h>
+#include <algorithm>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PIXEL_KERNELS_X86
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define PIXEL_KERNELS_X86
+#define TARGET_SSE2
+#define TARGET_AVX2
+#include <intrin.h>
+#endif
+
+#ifdef PIXEL_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using agg::int8u;
+
+// Fill bytes of pattern with copies of the size byte pixel; bytes is a multiple of 3 and 4.
+void Repeat(int8u* pattern, unsigned bytes, const int8u* pixel, unsigned size) {
+	for (unsigned i = 0; i < bytes; i++)
+		pattern[i] = pixel[i % size];
+}
+
+bool Overlap(const int8u* a, const int8u* b, size_t bytes) {
+	size_t x = (size_t) a, y = (size_t) b;
+	return x < y + bytes && y < x + bytes;
+}
+
+// ----------------------------------------------------------------------------
+// plain C++, a pixel at a time like AGG
+// ----------------------------------------------------------------------------
+
+void FillScalar(int8u* dst, unsigned n, const int8u* pixel, unsigned size) {
+	if (!n)
+		return;
+	// one pixel, then keep doubling what is done
+	const size_t bytes = size_t(n) * size;
+	memcpy(dst, pixel, size);
+	for (size_t done = size; done < bytes; done *= 2)
+		memcpy(dst + done, dst, std::min(done, bytes - done));
+}
+
+void BlendScalar(int8u* dst, const int8u* src, unsigned n, const int8u* pixel, unsigned size, int alpha_index, unsigned alpha) {
+	const unsigned inv = 256 - alpha;
+	for (; n; n--, dst += size, src += size)
+		for (unsigned i = 0; i < size; i++) {
+			unsigned d = src[i];
+			if ((int) i == alpha_index)
+				dst[i] = (int8u) (d + alpha - ((d * alpha + 255) >> 8));
+			else
+				dst[i] = (int8u) ((d * inv + pixel[i] * alpha) >> 8);
+		}
+}
+
+void CopyScalar(int8u* dst, const int8u* src, size_t bytes) {
+	memmove(dst, src, bytes);
+}
+
+#ifdef PIXEL_KERNELS_X86
+
+// ----------------------------------------------------------------------------
+// SSE2: blocks of 48 bytes, 16 pixels of 3 bytes or 12 of 4
+// ----------------------------------------------------------------------------
+
+TARGET_SSE2 void FillSSE2(int8u* dst, unsigned n, const int8u* pixel, unsigned size) {
+	int8u pattern[48];
+	Repeat(pattern, 48, pixel, size);
+	const __m128i p0 = _mm_loadu_si128((const __m128i*) pattern);
+	const __m128i p1 = _mm_loadu_si128((const __m128i*) (pattern + 16));
+	const __m128i p2 = _mm_loadu_si128((const __m128i*) (pattern + 32));
+	const unsigned block = 48 / size;
+	for (; n >= block; n -= block, dst += 48) {
+		_mm_storeu_si128((__m128i*) dst, p0);
+		_mm_storeu_si128((__m128i*) (dst + 16), p1);
+		_mm_storeu_si128((__m128i*) (dst + 32), p2);
+	}
+	FillScalar(dst, n, pixel, size);
+}
+
+// What BlendScalar does to 16 bytes: c times alpha is in clo and chi (low and high 8 bytes
+// widened to 16 bits), inv is 256 - alpha, and mask has the bytes that are alpha set.
+template <bool HasAlpha>
+TARGET_SSE2 inline __m128i Blend16(__m128i d, __m128i clo, __m128i chi, __m128i mask, __m128i inv, __m128i a16) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo = _mm_unpacklo_epi8(d, zero), hi = _mm_unpackhi_epi8(d, zero);
+	__m128i r = _mm_packus_epi16(
+		_mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, inv), clo), 8),
+		_mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, inv), chi), 8));
+	if (HasAlpha) {
+		const __m128i round = _mm_set1_epi16(255);
+		__m128i a = _mm_packus_epi16(
+			_mm_sub_epi16(_mm_add_epi16(lo, a16), _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, a16), round), 8)),
+			_mm_sub_epi16(_mm_add_epi16(hi, a16), _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, a16), round), 8)));
+		r = _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, r));
+	}
+	return r;
+}
+
+template <bool HasAlpha>
+TARGET_SSE2 void BlendSSE2(int8u* dst, const int8u* src, unsigned n, const int8u* pixel, unsigned size, int alpha_index, unsigned alpha) {
+	int8u pattern[48], alphas[48];
+	Repeat(pattern, 48, pixel, size);
+	for (unsigned i = 0; i < 48; i++)
+		alphas[i] = (int) (i % size) == alpha_index? 0xFF:0;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i inv = _mm_set1_epi16((short) (256 - alpha)), a16 = _mm_set1_epi16((short) alpha);
+	__m128i clo[3], chi[3], mask[3];
+	for (int k = 0; k < 3; k++) {
+		const __m128i c = _mm_loadu_si128((const __m128i*) (pattern + k * 16));
+		clo[k] = _mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), a16);
+		chi[k] = _mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), a16);
+		mask[k] = _mm_loadu_si128((const __m128i*) (alphas + k * 16));
+	}
+
+	const unsigned block = 48 / size;
+	for (; n >= block; n -= block, dst += 48, src += 48)
+		for (int k = 0; k < 3; k++) {
+			const __m128i d = _mm_loadu_si128((const __m128i*) (src + k * 16));
+			_mm_storeu_si128((__m128i*) (dst + k * 16), Blend16<HasAlpha>(d, clo[k], chi[k], mask[k], inv, a16));
+		}
+	BlendScalar(dst, src, n, pixel, size, alpha_index, alpha);
+}
+
+TARGET_SSE2 void BlendSSE2(int8u* dst, const int8u* src, unsigned n, const int8u* pixel, unsigned size, int alpha_index, unsigned alpha) {
+	if (alpha_index >= 0)
+		BlendSSE2<true>(dst, src, n, pixel, size, alpha_index, alpha);
+	else
+		BlendSSE2<false>(dst, src, n, pixel, size, alpha_index, alpha);
+}
+
+TARGET_SSE2 void CopySSE2(int8u* dst, const int8u* src, size_t bytes) {
+	if (Overlap(dst, src, bytes)) {
+		memmove(dst, src, bytes);
+		return;
+	}
+	for (; bytes >= 64; bytes -= 64, dst += 64, src += 64) {
+		const __m128i a = _mm_loadu_si128((const __m128i*) src);
+		const __m128i b = _mm_loadu_si128((const __m128i*) (src + 16));
+		const __m128i c = _mm_loadu_si128((const __m128i*) (src + 32));
+		const __m128i d = _mm_loadu_si128((const __m128i*) (src + 48));
+		_mm_storeu_si128((__m128i*) dst, a);
+		_mm_storeu_si128((__m128i*) (dst + 16), b);
+		_mm_storeu_si128((__m128i*) (dst + 32), c);
+		_mm_storeu_si128((__m128i*) (dst + 48), d);
+	}
+	memcpy(dst, src, bytes);
+}
+
+// ----------------------------------------------------------------------------
+// AVX2: the same in blocks of 96 bytes, 32 pixels of 3 bytes or 24 of 4
+// ----------------------------------------------------------------------------
+
+TARGET_AVX2 void FillAVX2(int8u* dst, unsigned n, const int8u* pixel, unsigned size) {
+	int8u pattern[96];
+	Repeat(pattern, 96, pixel, size);
+	const __m256i p0 = _mm256_loadu_si256((const __m256i*) pattern);
+	const __m256i p1 = _mm256_loadu_si256((const __m256i*) (pattern + 32));
+	const __m256i p2 = _mm256_loadu_si256((const __m256i*) (pattern + 64));
+	const unsigned block = 96 / size;
+	for (; n >= block; n -= block, dst += 96) {
+		_mm256_storeu_si256((__m256i*) dst, p0);
+		_mm256_storeu_si256((__m256i*) (dst + 32), p1);
+		_mm256_storeu_si256((__m256i*) (dst + 64), p2);
+	}
+	FillScalar(dst, n, pixel, size);
+}
+
+// Blend16 on 32 bytes; unpacking and packing both work within 128-bit lanes, so the
+// bytes come back where they were
+template <bool HasAlpha>
+TARGET_AVX2 inline __m256i Blend32(__m256i d, __m256i clo, __m256i chi, __m256i mask, __m256i inv, __m256i a16) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lo = _mm256_unpacklo_epi8(d, zero), hi = _mm256_unpackhi_epi8(d, zero);
+	__m256i r = _mm256_packus_epi16(
+		_mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, inv), clo), 8),
+		_mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, inv), chi), 8));
+	if (HasAlpha) {
+		const __m256i round = _mm256_set1_epi16(255);
+		__m256i a = _mm256_packus_epi16(
+			_mm256_sub_epi16(_mm256_add_epi16(lo, a16), _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, a16), round), 8)),
+			_mm256_sub_epi16(_mm256_add_epi16(hi, a16), _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, a16), round), 8)));
+		r = _mm256_blendv_epi8(r, a, mask);
+	}
+	return r;
+}
+
+template <bool HasAlpha>
+TARGET_AVX2 void BlendAVX2(int8u* dst, const int8u* src, unsigned n, const int8u* pixel, unsigned size, int alpha_index, unsigned alpha) {
+	int8u pattern[96], alphas[96];
+	Repeat(pattern, 96, pixel, size);
+	for (unsigned i = 0; i < 96; i++)
+		alphas[i] = (int) (i % size) == alpha_index? 0xFF:0;
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i inv = _mm256_set1_epi16((short) (256 - alpha)), a16 = _mm256_set1_epi16((short) alpha);
+	__m256i clo[3], chi[3], mask[3];
+	for (int k = 0; k < 3; k++) {
+		const __m256i c = _mm256_loadu_si256((const __m256i*) (pattern + k * 32));
+		clo[k] = _mm256_mullo_epi16(_mm256_unpacklo_epi8(c, zero), a16);
+		chi[k] = _mm256_mullo_epi16(_mm256_unpackhi_epi8(c, zero), a16);
+		mask[k] = _mm256_loadu_si256((const __m256i*) (alphas + k * 32));
+	}
+
+	const unsigned block = 96 / size;
+	for (; n >= block; n -= block, dst += 96, src += 96)
+		for (int k = 0; k < 3; k++) {
+			const __m256i d = _mm256_loadu_si256((const __m256i*) (src + k * 32));
+			_mm256_storeu_si256((__m256i*) (dst + k * 32), Blend32<HasAlpha>(d, clo[k], chi[k], mask[k], inv, a16));
+		}
+	BlendScalar(dst, src, n, pixel, size, alpha_index, alpha);
+}
+
+TARGET_AVX2 void BlendAVX2(int8u* dst, const int8u* src, unsigned n, const int8u* pixel, unsigned size, int alpha_index, unsigned alpha) {
+	if (alpha_index >= 0)
+		BlendAVX2<true>(dst, src, n, pixel, size, alpha_index, alpha);
+	else
+		BlendAVX2<false>(dst, src, n, pixel, size, alpha_index, alpha);
+}
+
+TARGET_AVX2 void CopyAVX2(int8u* dst, const int8u* src, size_t bytes) {
+	if (Overlap(dst, src, bytes)) {
+		memmove(dst, src, bytes);
+		return;
+	}
+	for (; bytes >= 128; bytes -= 128, dst += 128, src += 128) {
+		const __m256i a = _mm256_loadu_si256((const __m256i*) src);
+		const __m256i b = _mm256_loadu_si256((const __m256i*) (src + 32));
+		const __m256i c = _mm256_loadu_si256((const __m256i*) (src + 64));
+		const __m256i d = _mm256_loadu_si256((const __m256i*) (src + 96));
+		_mm256_storeu_si256((__m256i*) dst, a);
+		_mm256_storeu_si256((__m256i*) (dst + 32), b);
+		_mm256_storeu_si256((__m256i*) (dst + 64), c);
+		_mm256_storeu_si256((__m256i*) (dst + 96), d);
+	}
+	memcpy(dst, src, bytes);
+}
+
+#else
+
+// no SIMD kernels for this CPU; Best() never picks these
+#define FillSSE2 FillScalar
+#define BlendSSE2 BlendScalar
+#define CopySSE2 CopyScalar
+#define FillAVX2 FillScalar
+#define BlendAVX2 BlendScalar
+#define CopyAVX2 CopyScalar
+
+#endif
+
+struct Kernels {
+	void (*fill)(int8u* dst, unsigned n, const int8u* pixel, unsigned size);
+	void (*blend)(int8u* dst, const int8u* src, unsigned n, const int8u* pixel, unsigned size, int alpha_index, unsigned alpha);
+	void (*copy)(int8u* dst, const int8u* src, size_t bytes);
+};
+
+const Kernels kernels[] = {
+	{ FillScalar, BlendScalar, CopyScalar },
+	{ FillSSE2, BlendSSE2, CopySSE2 },
+	{ FillAVX2, BlendAVX2, CopyAVX2 }
+};
+
+GUI::PixelKernels::Level Detect() {
+#if defined(PIXEL_KERNELS_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int ids = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	// AVX needs the OS to save the YMM registers too
+	bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	bool avx2 = false;
+	if (avx && ids >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+	return avx2? GUI::PixelKernels::AVX2:sse2? GUI::PixelKernels::SSE2:GUI::PixelKernels::SCALAR;
+#elif defined(PIXEL_KERNELS_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return GUI::PixelKernels::AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return GUI::PixelKernels::SSE2;
+	return GUI::PixelKernels::SCALAR;
+#else
+	return GUI::PixelKernels::SCALAR;
+#endif
+}
+
+// Scalar until the dynamic initialization below has run.
+const Kernels* active = &kernels[GUI::PixelKernels::SCALAR];
+GUI::PixelKernels::Level current_level = GUI::PixelKernels::SCALAR;
+
+const GUI::PixelKernels::Level best_level = Detect();
+const bool selected = GUI::PixelKernels::Use(best_level);
+
+}
+
+namespace GUI {
+namespace PixelKernels {
+
+Level Best() {
+	return best_level;
+}
+
+Level Current() {
+	return current_level;
+}
+
+bool Use(Level level) {
+	if (level > best_level)
+		return false;
+	active = &kernels[level];
+	current_level = level;
+	return true;
+}
+
+const char* Name(Level level) {
+	static const char* names[] = { "scalar", "sse2", "avx2" };
+	return names[level];
+}
+
+void Fill(agg::int8u* dst, unsigned n, const agg::int8u* pixel, unsigned size) {
+	active->fill(dst, n, pixel, size);
+}
+
+void Blend(agg::int8u* dst, unsigned n, const agg::int8u* pixel, unsigned size, int alpha_index, unsigned alpha) {
+	active->blend(dst, dst, n, pixel, size, alpha_index, alpha);
+}
+
+void Blend(agg::int8u* dst, const agg::int8u* src, unsigned n, const agg::int8u* pixel, unsigned size, int alpha_index, unsigned alpha) {
+	active->blend(dst, src, n, pixel, size, alpha_index, alpha);
+}
+
+void Copy(agg::int8u* dst, const agg::int8u* src, size_t bytes) {
+	active->copy(dst, src, bytes);
+}
+
+}
+}
@@ -0,0 +1,130 @@
+#ifndef WX_AGG_PIXEL_KERNELS_H
+#define WX_AGG_PIXEL_KERNELS_H
+
+#include "agg_basics.h"
+#include "agg_rendering_buffer.h"
+
+#include <stddef.h>
+
+namespace GUI {
+
+// Fills, blends and copies of whole runs of 24 or 32-bit pixels, in SSE2 and AVX2
+// where the CPU has them and plain C++ where it doesn't. The best the CPU can run
+// is picked when the program starts.
+namespace PixelKernels {
+
+	// The instruction sets the kernels come in, slowest first.
+	enum Level { SCALAR, SSE2, AVX2 };
+
+	// The best level this CPU can run.
+	Level Best();
+	// The level in use.
+	Level Current();
+	// Use the kernels of level from now on; false, and no change, if the CPU can't run them.
+	bool Use(Level level);
+	// "scalar", "sse2" or "avx2".
+	const char* Name(Level level);
+
+	// Set the n pixels of size (3 or 4) bytes at dst to pixel.
+	void Fill(agg::int8u* dst, unsigned n, const agg::int8u* pixel, unsigned size);
+
+	// Blend pixel into the n pixels at dst with alpha (0 to 255) the way AGG's rgb and rgba
+	// blenders do: a colour byte d becomes (d * (256 - alpha) + c * alpha) / 256, the alpha
+	// byte at alpha_index (-1 if there is none) becomes d + alpha - (d * alpha + 255) / 256,
+	// rounded down.
+	void Blend(agg::int8u* dst, unsigned n, const agg::int8u* pixel, unsigned size, int alpha_index, unsigned alpha);
+	// The same blend, reading the n pixels from src instead of dst; src may be dst but
+	// may not overlap it otherwise.
+	void Blend(agg::int8u* dst, const agg::int8u* src, unsigned n, const agg::int8u* pixel, unsigned size, int alpha_index, unsigned alpha);
+
+	// Copy bytes from src to dst, which may overlap.
+	void Copy(agg::int8u* dst, const agg::int8u* src, size_t bytes);
+}
+
+// An AGG pixel format that does its horizontal fills, constant colour blends and copies
+// with PixelKernels, and everything else the way Base does. renderer_base clears, fills
+// and blends bars, and copies from other buffers, a row at a time through these.
+template <class Base>
+class KernelPixelFormat : public Base {
+public:
+	typedef Base base_type;
+	typedef typename Base::color_type color_type;
+	typedef typename Base::rbuf_type rbuf_type;
+
+	KernelPixelFormat() : buf(0) {}
+	explicit KernelPixelFormat(rbuf_type& rb) : Base(rb), buf(&rb) {}
+
+	void attach(rbuf_type& rb) {
+		Base::attach(rb);
+		buf = &rb;
+	}
+
+	void copy_hline(int x, int y, unsigned len, const color_type& c) {
+		agg::int8u pixel[Base::pix_width];
+		PixelOf(c, pixel);
+		PixelKernels::Fill(buf->row_ptr(y) + x * Base::pix_width, len, pixel, Base::pix_width);
+	}
+
+	void blend_hline(int x, int y, unsigned len, const color_type& c, agg::int8u cover) {
+		if (!c.a)
+			return;
+		unsigned alpha = (unsigned(c.a) * (unsigned(cover) + 1)) >> 8;
+		if (alpha == 255) {
+			copy_hline(x, y, len, c);
+			return;
+		}
+		agg::int8u pixel[Base::pix_width];
+		PixelOf(c, pixel);
+		PixelKernels::Blend(buf->row_ptr(y) + x * Base::pix_width, len, pixel, Base::pix_width, AlphaIndex(), alpha);
+	}
+
+	// blend_hline with full cover over len pixels read from src rather than the row: the
+	// row ends up as src with c laid over it, whatever it held before.
+	void blend_hline_from(int x, int y, unsigned len, const agg::int8u* src, const color_type& c) {
+		agg::int8u* p = buf->row_ptr(y) + x * Base::pix_width;
+		if (!c.a) {
+			PixelKernels::Copy(p, src, len * Base::pix_width);
+			return;
+		}
+		agg::int8u pixel[Base::pix_width];
+		PixelOf(c, pixel);
+		if (c.a == 255)
+			PixelKernels::Fill(p, len, pixel, Base::pix_width);
+		else
+			PixelKernels::Blend(p, src, len, pixel, Base::pix_width, AlphaIndex(), c.a);
+	}
+
+	template <class RenBuf2>
+	void copy_from(const RenBuf2& from, int xdst, int ydst, int xsrc, int ysrc, unsigned len) {
+		const agg::int8u* p = from.row_ptr(ysrc);
+		if (p)
+			PixelKernels::Copy(buf->row_ptr(ydst) + xdst * Base::pix_width, p + xsrc * Base::pix_width, len * Base::pix_width);
+	}
+
+private:
+	// The bytes Base stores c as.
+	static void PixelOf(const color_type& c, agg::int8u* pixel) {
+		rbuf_type rb(pixel, 1, 1, Base::pix_width);
+		Base pf(rb);
+		pf.copy_pixel(0, 0, c);
+	}
+
+	// Where Base keeps the alpha of a pixel, -1 if it doesn't.
+	static int AlphaIndex() {
+		if (Base::pix_width < 4)
+			return -1;
+		agg::int8u opaque[Base::pix_width], clear[Base::pix_width];
+		PixelOf(color_type(0, 0, 0, 255), opaque);
+		PixelOf(color_type(0, 0, 0, 0), clear);
+		for (int i = 0; i < Base::pix_width; i++)
+			if (opaque[i] != clear[i])
+				return i;
+		return -1;
+	}
+
+	rbuf_type* buf;
+};
+
+}
+
+#endif